@@ -0,0 +1,162 @@
+#!/usr/bin/env bash
+#
+# bench.sh - calibrate the suite against itself over loopback.
+#
+# Runs hstress and hplay against hserve across a grid of parameters
+# and writes one tab-separated line per run to stdout. The grid is
+# set from the environment; see the defaults below. Each server also
+# gets a HEAD run, which has to come back without a body.
+#
+# hz is the most requests per second hstress got out of the server.
+# hplay sends at a fixed QPS instead, so its rows have no hz but a
+# rate: the pace it kept, which is not the most the server can take.
+#
+# CPU times come from the kernel (bash's time for the clients,
+# /proc/PID/stat for the server), so this needs Linux.
+
+set -e
+
+PORT=${PORT:-18080}
+N=${N:-50000}			# requests per hstress run
+CS=${CS:-"1 16 128"}		# hstress -c
+PS=${PS:-"1 2"}			# hstress -p
+SIZES=${SIZES:-"0 1024 65536"}	# hserve -s
+RPCS=${RPCS:-"-1 100 1"}	# hstress -r
+QPSS=${QPSS:-"100 1000"}	# hplay rates; each sends QPS requests
+NETS=${NETS:-"tcp unix"}	# loopback TCP, a Unix domain socket, tls or h2c
+RESUME=${RESUME:-0}		# hstress -T, for tls
+STREAMS=${STREAMS:-16}		# hstress -H, for h2c
+
+dir=$(cd "$(dirname "$0")" && pwd)
+tmp=$(mktemp -d)
+server=
+
+cleanup(){
+	[ -n "$server" ] && kill $server 2>/dev/null
+	rm -rf $tmp
+}
+trap cleanup EXIT
+
+hz=$(getconf CLK_TCK)
+
+servercpu(){
+	awk '{print $14 + $15}' /proc/$server/stat
+}
+
+# startserver SIZE NET: sets server, and target to the client arguments
+startserver(){
+	if [ $2 = unix ]; then
+		target="unix:$tmp/sock 0"
+		"$dir"/hserve -s $1 unix:$tmp/sock >/dev/null 2>&1 &
+	elif [ $2 = tls ]; then
+		[ -f $tmp/cert ] || openssl req -x509 -newkey rsa:2048 -nodes \
+		    -subj /CN=localhost -days 1 -keyout $tmp/cert -out $tmp/cert \
+		    2>/dev/null
+		target="-T $RESUME 127.0.0.1 $PORT"
+		"$dir"/hserve -c $tmp/cert -s $1 $PORT >/dev/null 2>&1 &
+	elif [ $2 = h2c ]; then
+		target="-H $STREAMS 127.0.0.1 $PORT"
+		"$dir"/hserve -2 -s $1 $PORT >/dev/null 2>&1 &
+	else
+		target="127.0.0.1 $PORT"
+		"$dir"/hserve -s $1 $PORT >/dev/null 2>&1 &
+	fi
+	server=$!
+	# wait for the listener
+	for i in $(seq 50); do
+		if [ $2 = unix ]; then
+			[ -S $tmp/sock ] && return
+		else
+			(exec 3<>/dev/tcp/127.0.0.1/$PORT) 2>/dev/null && return
+		fi
+		sleep 0.1
+	done
+	echo "hserve did not come up" >&2
+	exit 1
+}
+
+stopserver(){
+	kill $server
+	wait $server 2>/dev/null || true
+	rm -f $tmp/sock
+	server=
+}
+
+# field NAME FILE: the value of a "# NAME" summary line from hstress
+field(){
+	awk -v k="$1" '$1 == "#" && $2 == k {print $3; exit}' $2
+}
+
+# usperreq TIME_FILE N: client CPU microseconds per request
+usperreq(){
+	awk -v n=$2 '{printf "%.2f", (n > 0 ? ($2 + $3) * 1e6 / n : 0)}' $1
+}
+
+# serverus TICKS N
+serverus(){
+	awk -v t=$1 -v hz=$hz -v n=$2 'BEGIN{printf "%.2f", (n > 0 ? t * 1e6 / hz / n : 0)}'
+}
+
+# stress C P RPC METHOD: an hstress run, and its line
+stress(){
+	m=
+	[ $4 != GET ] && m="-m $4"
+	s0=$(servercpu)
+	{ time "$dir"/hstress -n $N -c $1 -p $2 -r $3 $m $target \
+	    >/dev/null 2>$tmp/out ; } 2>$tmp/time
+	s1=$(servercpu)
+
+	n=$(field successes $tmp/out)
+	printf "hstress\t%s\t%s\t%d\t%d\t%d\t%d\t%d\t%s\t-\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n" \
+	    $4 $net $1 $2 $size $3 $n \
+	    $(field hz $tmp/out) \
+	    $(usperreq $tmp/time $n) \
+	    $(serverus $((s1 - s0)) $n) \
+	    $(field p50 $tmp/out) $(field p90 $tmp/out) \
+	    $(field p99 $tmp/out) $(field p99.9 $tmp/out) \
+	    $(field errors $tmp/out) $(field timeouts $tmp/out)
+}
+
+printf "tool\tmethod\tnet\tc\tp\tsize\trpc\tn\thz\trate\tclient_us\tserver_us\tp50\tp90\tp99\tp99.9\terrors\ttimeouts\n"
+
+TIMEFORMAT='%3R %3U %3S'
+
+for net in $NETS; do
+for size in $SIZES; do
+	startserver $size $net
+
+	for c in $CS; do
+	for p in $PS; do
+	for r in $RPCS; do
+		stress $c $p $r GET
+	done
+	done
+	done
+
+	# errors here are a body sent with HEAD; hstress has no -m for h2c
+	if [ $net != h2c ]; then
+		set -- $CS
+		stress $1 1 -1 HEAD
+	fi
+
+	qpss=$QPSS
+	[ $net = tls -o $net = h2c ] && qpss=	# hplay has no TLS or h2
+
+	printf "GET / HTTP/1.1\r\nHost: 127.0.0.1:$PORT\r\n\r\n" > $tmp/reqs
+	for qps in $qpss; do
+		n=$qps
+		s0=$(servercpu)
+		{ time "$dir"/hplay -n $n $target $qps $tmp/reqs \
+		    >/dev/null 2>&1 ; } 2>$tmp/time
+		s1=$(servercpu)
+
+		printf "hplay\tGET\t%s\t-\t1\t%d\t-\t%d\t-\t%s\t%s\t%s\t-\t-\t-\t-\t-\t-\n" \
+		    $net $size $n \
+		    $(awk -v n=$n '{printf "%d", ($1 > 0 ? n / $1 : 0)}' $tmp/time) \
+		    $(usperreq $tmp/time $n) \
+		    $(serverus $((s1 - s0)) $n)
+	done
+
+	stopserver
+done
+done
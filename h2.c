@@ -0,0 +1,117 @@
+#include <sys/types.h>
+#include <string.h>
+#include <stdint.h>
+#include <event.h>
+
+#include "u.h"
+#include "h2.h"
+
+uint32_t
+h2get32(uint8_t *p)
+{
+	return (uint32_t)p[0]<<24 | p[1]<<16 | p[2]<<8 | p[3];
+}
+
+static uint8_t *
+put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v>>24;
+	p[1] = v>>16;
+	p[2] = v>>8;
+	p[3] = v;
+	return p + 4;
+}
+
+/*
+	Is there a whole frame at the head of in? Then its header goes
+	in f, and 1 is returned; the frame is left for the caller to
+	take and drain. -1 is a frame bigger than we allow.
+*/
+int
+h2next(struct evbuffer *in, struct h2frame *f)
+{
+	uint8_t h[H2hdr];
+
+	if(evbuffer_copyout(in, h, H2hdr) < H2hdr)
+		return 0;
+
+	f->len = h[0]<<16 | h[1]<<8 | h[2];
+	f->type = h[3];
+	f->flags = h[4];
+	f->sid = h2get32(h + 5) & 0x7fffffff;
+
+	if(f->len > H2maxframe)
+		return -1;
+	return evbuffer_get_length(in) >= H2hdr + f->len;
+}
+
+/* A frame header, for a payload of len to follow. */
+void
+h2hdr(struct evbuffer *out, int type, int flags, uint32_t sid, size_t len)
+{
+	uint8_t h[H2hdr];
+
+	h[0] = len>>16;
+	h[1] = len>>8;
+	h[2] = len;
+	h[3] = type;
+	h[4] = flags;
+	put32(h + 5, sid);
+	evbuffer_add(out, h, H2hdr);
+}
+
+void
+h2put(struct evbuffer *out, int type, int flags, uint32_t sid, void *p, size_t len)
+{
+	h2hdr(out, type, flags, sid, len);
+	if(len > 0)
+		evbuffer_add(out, p, len);
+}
+
+/* One setting into a SETTINGS payload at p; returns the next. */
+uint8_t *
+h2setting(uint8_t *p, int id, uint32_t v)
+{
+	p[0] = id>>8;
+	p[1] = id;
+	return put32(p + 2, v);
+}
+
+void
+h2window(struct evbuffer *out, uint32_t sid, uint32_t incr)
+{
+	uint8_t p[4];
+
+	put32(p, incr);
+	h2put(out, Twindow, 0, sid, p, sizeof(p));
+}
+
+void
+h2rst(struct evbuffer *out, uint32_t sid, uint32_t code)
+{
+	uint8_t p[4];
+
+	put32(p, code);
+	h2put(out, Trst, 0, sid, p, sizeof(p));
+}
+
+/*
+	An HPACK integer with a prefix-bit prefix, or'd into first;
+	returns its length.
+*/
+int
+hpackint(uint8_t *p, int prefix, int first, uint32_t v)
+{
+	int n, max = (1<<prefix) - 1;
+
+	if(v < max){
+		p[0] = first | v;
+		return 1;
+	}
+
+	p[0] = first | max;
+	for(v -= max, n = 1; v >= 128; v >>= 7)
+		p[n++] = 0x80 | (v & 0x7f);
+	p[n++] = v;
+	return n;
+}
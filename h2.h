@@ -0,0 +1,65 @@
+/*
+	HTTP/2 framing, as much as the tools need. They speak it in the
+	clear with prior knowledge (h2c), and neither side decodes the
+	other's headers: a stream's end is all we look for.
+*/
+
+#define H2PREFACE	"PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+
+enum{
+	H2npreface = 24,
+	H2hdr = 9,		/* frame header */
+	H2maxframe = 16384,	/* SETTINGS_MAX_FRAME_SIZE; we never raise it */
+	H2window = 65535,	/* the initial window, stream and connection */
+};
+
+enum{	/* frame types */
+	Tdata,
+	Theaders,
+	Tpriority,
+	Trst,
+	Tsettings,
+	Tpush,
+	Tping,
+	Tgoaway,
+	Twindow,
+	Tcont,
+};
+
+enum{	/* frame flags */
+	Fendstream = 0x1,
+	Fack = 0x1,
+	Fendheaders = 0x4,
+	Fpadded = 0x8,
+	Fpriority = 0x20,
+};
+
+enum{	/* settings */
+	Stablesize = 1,
+	Spush,
+	Smaxstreams,
+	Swindow,
+	Sframe,
+};
+
+enum{	/* error codes */
+	Enone,
+	Eprotocol,
+	Ecancel = 8,
+};
+
+struct h2frame{
+	uint32_t len;
+	int type;
+	int flags;
+	uint32_t sid;
+};
+
+int	h2next(struct evbuffer *in, struct h2frame *f);
+void	h2hdr(struct evbuffer *out, int type, int flags, uint32_t sid, size_t len);
+void	h2put(struct evbuffer *out, int type, int flags, uint32_t sid, void *p, size_t len);
+uint8_t	*h2setting(uint8_t *p, int id, uint32_t v);
+void	h2window(struct evbuffer *out, uint32_t sid, uint32_t incr);
+void	h2rst(struct evbuffer *out, uint32_t sid, uint32_t code);
+uint32_t	h2get32(uint8_t *p);
+int	hpackint(uint8_t *p, int prefix, int first, uint32_t v);
@@ -0,0 +1,115 @@
+#include <sys/types.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "hist.h"
+
+static int
+histindex(int64_t v)
+{
+	int shift;
+
+	if(v < 0)
+		v = 0;
+	if(v >= (int64_t)1<<Hmax)
+		v = ((int64_t)1<<Hmax) - 1;
+	if(v < 2*Nsub)
+		return v;
+
+	shift = 63 - __builtin_clzll(v) - Hsub;
+	return shift*Nsub + (v >> shift);
+}
+
+/* the midpoint of bucket i */
+static int64_t
+histvalue(int i)
+{
+	int shift;
+
+	if(i < 2*Nsub)
+		return i;
+
+	shift = i/Nsub - 1;
+	return ((int64_t)(i%Nsub + Nsub) << shift) + ((int64_t)1 << shift)/2;
+}
+
+void
+histadd(struct hist *h, int64_t ns)
+{
+	h->b[histindex(ns)]++;
+	h->n++;
+}
+
+void
+histmerge(struct hist *dst, struct hist *src)
+{
+	int i;
+
+	if(src->n == 0)
+		return;
+
+	for(i=0; i<Nhist; i++)
+		dst->b[i] += src->b[i];
+	dst->n += src->n;
+}
+
+void
+histclear(struct hist *h)
+{
+	memset(h, 0, sizeof(*h));
+}
+
+int64_t
+histquantile(struct hist *h, double q)
+{
+	uint64_t rank, sum;
+	int i;
+
+	if(h->n == 0)
+		return 0;
+
+	rank = q * h->n;
+	if(rank >= h->n)
+		rank = h->n - 1;
+
+	for(i=0, sum=0; i<Nhist; i++){
+		sum += h->b[i];
+		if(sum > rank)
+			return histvalue(i);
+	}
+
+	return histvalue(Nhist - 1);
+}
+
+/* e must have room for Nhist entries; returns the number used. */
+int
+histpack(struct hist *h, struct histent *e)
+{
+	int i, n;
+
+	if(h->n == 0)
+		return 0;
+
+	for(i=0, n=0; i<Nhist; i++){
+		if(h->b[i] == 0)
+			continue;
+		e[n].i = i;
+		e[n].n = h->b[i];
+		n++;
+	}
+
+	return n;
+}
+
+void
+histunpack(struct hist *h, struct histent *e, int n)
+{
+	int i;
+
+	for(i=0; i<n; i++){
+		if(e[i].i >= Nhist)
+			continue;
+		h->b[e[i].i] += e[i].n;
+		h->n += e[i].n;
+	}
+}
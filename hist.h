@@ -0,0 +1,32 @@
+/*
+	Log-linear latency histograms. Values are in nanoseconds; each
+	power of two is split into Nsub buckets, so a bucket is never
+	wider than 1/Nsub of the values it holds. Histograms merge
+	exactly, which is what lets us aggregate percentiles across
+	processes.
+*/
+
+enum{
+	Hsub = 5,
+	Nsub = 1<<Hsub,
+	Hmax = 40,		/* values are clamped to 2^Hmax ns, ~18 minutes */
+	Nhist = (Hmax - Hsub + 2) * Nsub,
+};
+
+struct hist{
+	uint64_t n;
+	uint64_t b[Nhist];
+};
+
+/* a nonzero bucket, for shipping histograms around */
+struct histent{
+	uint32_t i;
+	uint32_t n;
+};
+
+void histadd(struct hist *h, int64_t ns);
+void histmerge(struct hist *dst, struct hist *src);
+void histclear(struct hist *h);
+int64_t histquantile(struct hist *h, double q);
+int histpack(struct hist *h, struct histent *e);
+void histunpack(struct hist *h, struct histent *e, int n);
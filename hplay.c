@@ -3,15 +3,21 @@
 	fairly robust to accomodate for packet dumps, etc.
 */
 
+#include <sys/types.h>
+#include <sys/socket.h>
 #include <event.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <signal.h>
+#include <ctype.h>
+#include <errno.h>
 #include <event.h>
-#include <evhttp.h>
 
 #include "u.h"
+#include "http.h"
+#include "net.h"
+#include "tmpl.h"
 
 struct Header{
 	char key[50];
@@ -26,12 +32,15 @@ enum{
 };
 
 struct Request{
-	char action[5];
+	char action[8];
 	char uri[1024];
 	char httpversion[20];
 	Header headers[10];
 	int nheader;
 	int nbody;
+	char *body;		/* as it came, chunks and all; or nil */
+	int chunked;
+	struct tmpl *tmpl;	/* with -x, if uri has placeholders */
 };
 typedef struct Request Request;
 
@@ -40,15 +49,25 @@ struct Run{
 	int rsiz;
 	struct timeval tv;
 	struct event ev;
-	char *host;
-	short port;
-	struct evhttp_connection *cachedconn;
+	struct sockaddr_storage addr;
+	char *hosthdr;		/* Host, when the request has none */
+	struct Call *cached;	/* an idle keep-alive connection */
+	char *uri;		/* a filled template; the longest fits */
+	int count;	/* stop after this many; <0: never */
+	int nsent;
+	int ndone;
 };
 typedef struct Run Run;
 
 struct Call{
 	Run *run;
-	struct evhttp_connection *conn;
+	int fd;
+	int connecting;
+	struct event rev;
+	struct event wev;
+	struct evbuffer *in;
+	struct evbuffer *out;
+	struct resp resp;
 };
 typedef struct Call Call;
 
@@ -150,13 +169,16 @@ zerorequest(Request *r)
 	}
 
 	r->nheader = r->nbody = 0;
+	r->body = nil;
+	r->chunked = 0;
+	r->tmpl = nil;
 }
 
 int
 isvalidaction(char *action)
 {
 	static char* actions[] ={
-		"GET", "POST", "PUT"
+		"GET", "POST", "PUT", "DELETE", "PATCH", "HEAD", "OPTIONS"
 	};
 	int i;
 
@@ -188,7 +210,9 @@ readfirstline(Request *r)
 		case 0:
 			if(!isvalidaction(fld))
 				return 0;
-			strcpy(r->action, fld);
+			for(n=0; fld[n] != '\0'; n++)
+				r->action[n] = toupper(fld[n]);
+			r->action[n] = '\0';
 			break;
 		case 1:
 			if (n > sizeof(r->uri)) return 0;
@@ -238,10 +262,58 @@ readheader(Header *hdr)
 	return 1;
 }
 
+/* n more bytes of the body, from the file or from p */
+int
+addbody(Request *r, char *p, size_t n)
+{
+	r->body = remal(r->body, r->nbody + n);
+	if(p != nil)
+		memcpy(r->body + r->nbody, p, n);
+	else if(fread(r->body + r->nbody, 1, n, io.file) != n)
+		return 0;
+	r->nbody += n;
+	return 1;
+}
+
+/*
+	The body, after the headers' blank line: Content-Length bytes,
+	or chunks, kept with their framing and trailers to be sent as
+	they are. 0 if the file ends first.
+*/
+int
+readbody(Request *r, int clen)
+{
+	char *line;
+	size_t n, len;
+
+	/* the headers we had no room for, and the blank line */
+	while((line = readline()) != nil && *line != '\0')
+		;
+	if(line == nil)
+		return 0;
+
+	if(!r->chunked)
+		return clen == 0 || addbody(r, nil, clen);
+
+	do{
+		if((line = xfgetln(io.file, &n)) == nil || !addbody(r, line, n))
+			return 0;
+		len = strtoul(line, nil, 16);
+		if(len > 0 && !addbody(r, nil, len + 2))
+			return 0;
+	}while(len > 0);
+	do{
+		if((line = xfgetln(io.file, &n)) == nil || !addbody(r, line, n))
+			return 0;
+	}while(line[0] != '\r' && line[0] != '\n');
+	return 1;
+}
+
 int
 readrequest(Request *r)
 {
 	int i, clen, nhdr;
+	size_t n;
 	
 	clen = 0;
 
@@ -251,13 +323,21 @@ readrequest(Request *r)
 
 	nhdr = sizeof(r->headers)/sizeof(r->headers[0]);
 	for(i=0; i < nhdr && readheader(&r->headers[i]); i++){
+		/* chunked comes last, if at all */
+		n = strlen(r->headers[i].value);
+		if(strcasecmp(r->headers[i].key, "transfer-encoding") == 0 &&
+		    n >= 7 && strcasecmp(r->headers[i].value + n - 7, "chunked") == 0)
+			r->chunked = 1;
 		if(strcasecmp(r->headers[i].key, "content-length"))
 			continue;
 
-		r->nbody = atoi(r->headers[i].value);
+		clen = atoi(r->headers[i].value);
 	}
 	r->nheader = i;
 
+	if((clen > 0 || r->chunked) && !readbody(r, clen))
+		return 0;
+
 /*
 	for(i=0; i<2; i++){
 		line = readline();
@@ -284,30 +364,119 @@ sayrequest(Request *r)
 	say("body = %d bytes", r->nbody);
 }
 
-struct evhttp_connection *
-mkconn(char *host, short port)
+/*
+	Connections. We speak HTTP/1.1 on our own sockets, rather than
+	through evhttp, so that any transport in net.h will do.
+*/
+
+void readcb(int fd, short what, void *arg);
+void writecb(int fd, short what, void *arg);
+
+Call *
+mkcall(Run *run)
 {
-	struct evhttp_connection *conn;
+	Call *c;
+	int fd;
 
-	if((conn = evhttp_connection_new(host, port)) == nil)
-		panic("evhttp_connection_new");
-		
-	return conn;
+	if((fd = netdial(&run->addr)) < 0)
+		return nil;
+
+	c = mal(sizeof(*c));
+	c->run = run;
+	c->fd = fd;
+	c->connecting = 1;
+	if((c->in = evbuffer_new()) == nil || (c->out = evbuffer_new()) == nil)
+		panic("evbuffer_new");
+	event_set(&c->rev, fd, EV_READ|EV_PERSIST, readcb, c);
+	event_set(&c->wev, fd, EV_WRITE|EV_PERSIST, writecb, c);
+	event_add(&c->rev, nil);
+
+	return c;
 }
 
 void
-donecb(struct evhttp_request *req, void *arg)
+freecall(Call *c)
+{
+	event_del(&c->rev);
+	event_del(&c->wev);
+	close(c->fd);
+	evbuffer_free(c->in);
+	evbuffer_free(c->out);
+	free(c);
+}
+
+/* The request on c is over; keep the connection if we can. */
+void
+donecall(Call *c, int ok)
 {
-	Call *call;
 	Run *run;
 
-	call = (Call*)arg;
-	run = call->run;
+	run = c->run;
 
-	if(run->cachedconn == nil)
-		run->cachedconn = call->conn;
+	if(ok && c->resp.keepalive && run->cached == nil)
+		run->cached = c;
 	else
-		evhttp_connection_free(call->conn);
+		freecall(c);
+
+	if(++run->ndone == run->count)
+		event_loopexit(nil);
+}
+
+void
+readcb(int fd, short what, void *arg)
+{
+	Call *c;
+	int n;
+
+	c = (Call*)arg;
+
+	n = evbuffer_read(c->in, fd, -1);
+	if(n < 0 && (errno == EAGAIN || errno == EINTR))
+		return;
+
+	if(c == c->run->cached){
+		/* the server hung up on our idle connection */
+		c->run->cached = nil;
+		freecall(c);
+		return;
+	}
+
+	switch(n > 0 ? respparse(&c->resp, c->in) : -1){
+	case 0:
+		return;
+	case 1:
+		donecall(c, 1);
+		return;
+	}
+
+	donecall(c, n == 0 && c->resp.state == Peof);
+}
+
+void
+writecb(int fd, short what, void *arg)
+{
+	Call *c;
+	int err;
+	socklen_t len;
+
+	c = (Call*)arg;
+
+	if(c->connecting){
+		len = sizeof(err);
+		if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0){
+			donecall(c, 0);
+			return;
+		}
+		c->connecting = 0;
+	}
+
+	if(evbuffer_write(c->out, fd) < 0 && errno != EAGAIN && errno != EINTR){
+		donecall(c, 0);
+		return;
+	}
+
+	if(evbuffer_get_length(c->out) == 0)
+		event_del(&c->wev);
 }
 
 void
@@ -317,60 +486,94 @@ runcb(int fd, short what, void *arg)
 	Request *r;
 	Call *c;
 	Header *h;
-	struct evhttp_connection *conn;
-	struct evhttp_request *req;
-	enum evhttp_cmd_type cmd;
-	int i;
+	int i, hashost;
+	size_t n;
 
 	run = (Run*)arg;
 	r = &run->rs[rand() % run->rsiz];
 
-	if(run->cachedconn!=nil){
-		conn = run->cachedconn;
-		run->cachedconn = nil;
-	}else
-		conn = mkconn(run->host, run->port);
+	if(++run->nsent != run->count)
+		event_add(&run->ev, &run->tv);
 
-	c = mal(sizeof(*c));
-	c->run = run;
-	c->conn = conn;
+	if(run->cached != nil){
+		c = run->cached;
+		run->cached = nil;
+	}else if((c = mkcall(run)) == nil){
+		if(++run->ndone == run->count)
+			event_loopexit(nil);
+		return;
+	}
 
-	req = evhttp_request_new(&donecb, c);
-
-	if(strcasecmp(r->action, "get")==0)
-		cmd = EVHTTP_REQ_GET;
-	else if(strcasecmp(r->action, "post")==0)
-		cmd = EVHTTP_REQ_POST;
-	else
-		panic("invalid action \"%s\"", r->action);
+	respinit(&c->resp);
+	c->resp.head = strcmp(r->action, "HEAD") == 0;
 
+	/* the body's length is what we read of it */
+	if(r->tmpl != nil){
+		n = tmplfill(r->tmpl, run->uri);
+		evbuffer_add_printf(c->out, "%s %.*s HTTP/1.1\r\n", r->action,
+		    (int)n, run->uri);
+	}else
+		evbuffer_add_printf(c->out, "%s %s HTTP/1.1\r\n", r->action, r->uri);
+	hashost = 0;
 	for(i=0;i<r->nheader;i++){
 		h = &r->headers[i];
-		evhttp_add_header(
-		    req->output_headers,
-		    h->key, h->value);
+		if(strcasecmp(h->key, "content-length") == 0)
+			continue;
+		if(strcasecmp(h->key, "host") == 0)
+			hashost = 1;
+		evbuffer_add_printf(c->out, "%s: %s\r\n", h->key, h->value);
 	}
+	if(!hashost)
+		evbuffer_add_printf(c->out, "Host: %s\r\n", run->hosthdr);
+	if(!r->chunked && (r->nbody > 0 || strcmp(r->action, "GET") != 0))
+		evbuffer_add_printf(c->out, "Content-Length: %d\r\n", r->nbody);
+	evbuffer_add(c->out, "\r\n", 2);
+	if(r->nbody > 0)
+		evbuffer_add_reference(c->out, r->body, r->nbody, nil, nil);
+
+	event_add(&c->wev, nil);
+}
 
-	evhttp_make_request(conn, req, cmd, r->uri);
-
-	event_add(&run->ev, &run->tv);
+void
+usage(char *cmd)
+{
+	panic("usage: %s [-x] [-n COUNT] host|unix:PATH port qps [file ...]", cmd);
 }
 
 int
 main(int argc, char **argv)
 {
-	char *host;
+	char *host, *cmd = argv[0];
 	int port, fail;
+	char hosthdr[300];
 	Request *rs;
 	Run run;
-	int n, i, qps;
+	int n, i, qps, ch, count, expand;
+	size_t maxuri;
 	FILE **fs, *f;
 
+	count = -1;
+	expand = 0;
+	while((ch = getopt(argc, argv, "n:x")) != -1){
+		switch(ch){
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 'x':
+			expand = 1;
+			break;
+		default:
+			usage(cmd);
+		}
+	}
+	argc -= optind - 1;
+	argv += optind - 1;
+
 	if(argc < 4)
-		panic("usage: %s host port qps [file ...]", argv[0]);
+		usage(cmd);
 	host = argv[1];
 	port = atoi(argv[2]);
-	if(port == 0)
+	if(port == 0 && !isunix(host))
 		panic("invalid port \"%s\"", argv[2]);
 	qps = atoi(argv[3]);
 	if(qps==0)
@@ -387,9 +590,10 @@ main(int argc, char **argv)
 		for(i=0;i<argc-4;i++){
 			fs[i] = fopen(argv[i+4], "r");
 			if(fs[i] == nil)
-				panic("failed to open \"%s\"", argv[i+3]);
+				panic("failed to open \"%s\"", argv[i+4]);
 		}
 		fs[i] = nil;
+		i = 0;
 	}else{
 		fs = alloca(2*sizeof(FILE*));
 		fs[0] = stdin;
@@ -412,15 +616,34 @@ main(int argc, char **argv)
 
 	say("parsed %d requests, failed %d", i, fail);
 
+	/* compile the templates among the URIs, once */
+	maxuri = 0;
+	for(n=0; expand && n<i; n++){
+		if(strchr(rs[n].uri, '{') == nil)
+			continue;
+		rs[n].tmpl = tmplparse(rs[n].uri);
+		tmplseed(rs[n].tmpl, 0, 1);
+		if(rs[n].tmpl->max > maxuri)
+			maxuri = rs[n].tmpl->max;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
 	event_init();
 	
 	run.rs = rs;
 	run.rsiz = i;
 	run.tv.tv_sec = 0;
 	run.tv.tv_usec = 1000000/qps;
-	run.host = host;
-	run.port = port;
-	run.cachedconn = nil;
+	netaddr(host, port, &run.addr);
+	if(isunix(host))
+		snprintf(hosthdr, sizeof(hosthdr), "localhost");
+	else
+		snprintf(hosthdr, sizeof(hosthdr), "%s:%d", host, port);
+	run.hosthdr = hosthdr;
+	run.cached = nil;
+	run.uri = mal(maxuri + 1);
+	run.count = count;
+	run.nsent = run.ndone = 0;
 
 	evtimer_set(&run.ev, runcb, &run);
 	evtimer_add(&run.ev, &run.tv);
@@ -0,0 +1,612 @@
+/*
+ * hrecord - a tee proxy that records the requests passing through
+ * it as a corpus for hplay.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <event.h>
+
+#include "u.h"
+#include "http.h"
+#include "net.h"
+
+enum{
+	Maxhead = 65536,	/* the longest request head we follow */
+	Maxpending = 1<<20,	/* per direction, before we stop reading */
+	Maxbacklog = 64<<20,	/* corpus not yet with the writer */
+};
+
+enum{	/* following the client's requests */
+	Shead,
+	Sbody,
+	Schunksize,
+	Schunk,
+	Strailers,
+	Spass,		/* lost track, or not HTTP/1 any more: just forward */
+};
+
+/* One end of a proxied connection, and what is to be written to it. */
+struct side{
+	int fd;
+	int eof;		/* it has no more for us */
+	int shut;		/* and the other end knows */
+	struct event rev;
+	struct event wev;
+	struct evbuffer *out;
+};
+
+struct pconn{
+	struct side cli;
+	struct side srv;
+	int connecting;
+	int state;
+	int drop;		/* the request in progress isn't recorded */
+	int64_t left;		/* body or chunk bytes to go */
+	struct evbuffer *rq;	/* from the client, not yet followed */
+};
+
+/*
+	Interval counters, as in hserve: the event loop owns them.
+*/
+struct{
+	int conns;		/* not reset; a gauge */
+	int accepts;
+	int errors;		/* could not reach the upstream */
+	int requests;
+	int dropped;		/* not recorded: the writer was behind */
+	int64_t bytes;		/* recorded */
+}counts;
+
+struct sockaddr_storage	upstream;
+struct evbuffer	*corpus;	/* records, on their way to the writer */
+int		corpusfd = -1;	/* the writer's pipe */
+struct event	corpusev;
+pid_t		writerpid;
+struct event	acceptev;
+struct event	intev;
+struct event	termev;
+struct event	reportev;
+struct timeval	reporttv = { 1, 0 };
+int64_t		lastreport;
+
+void readcb(int fd, short what, void *arg);
+void writecb(int fd, short what, void *arg);
+
+/*
+	Reporting.
+*/
+
+void
+reportcb(int fd, short what, void *arg)
+{
+	int64_t now, ns;
+
+	now = nsec();
+	ns = now - lastreport;
+	lastreport = now;
+
+	printts(&reporttv);
+	printf("%d\t%d\t%d\t%d\t%lld\t%d\t%d\n", counts.requests, counts.conns,
+	    counts.accepts, counts.errors, (long long)counts.bytes, counts.dropped,
+	    ns > 0 ? (int)(counts.requests * 1000000000LL / ns) : 0);
+	fflush(stdout);
+
+	counts.requests = counts.accepts = counts.errors = counts.dropped = 0;
+	counts.bytes = 0;
+}
+
+/*
+	The corpus. It is written by a process of its own, fed through
+	a nonblocking pipe, so that the disk never holds up the proxy:
+	we only write to the pipe when it has room, and when the
+	writer falls Maxbacklog behind, we drop whole requests rather
+	than wait for it.
+*/
+
+void
+corpuscb(int fd, short what, void *arg)
+{
+	if(evbuffer_write(corpus, fd) < 0 && errno != EAGAIN && errno != EINTR)
+		panic("corpus writer: %s", strerror(errno));
+	if(evbuffer_get_length(corpus) == 0)
+		event_del(&corpusev);
+}
+
+void
+writer(char *path)
+{
+	char buf[65536];
+	int p[2], fd;
+	ssize_t n;
+
+	if((fd = open(path, O_WRONLY|O_CREAT|O_APPEND, 0644)) < 0)
+		panic("%s: %s", path, strerror(errno));
+	if(pipe(p) < 0)
+		panic("pipe");
+
+	if((writerpid = fork()) < 0)
+		panic("fork");
+	if(writerpid == 0){
+		/* an interrupt is for the proxy; we write out what it sends */
+		signal(SIGINT, SIG_IGN);
+		signal(SIGTERM, SIG_IGN);
+		close(p[1]);
+		while((n = read(p[0], buf, sizeof(buf))) > 0){
+			if(atomicio(write, fd, buf, n) != n)
+				panic("%s: %s", path, strerror(errno));
+		}
+		close(fd);
+		exit(0);
+	}
+
+	close(p[0]);
+	close(fd);
+	evutil_make_socket_nonblocking(p[1]);
+	corpusfd = p[1];
+	if((corpus = evbuffer_new()) == nil)
+		panic("evbuffer_new");
+}
+
+/*
+	Hand what's left to the writer, and wait for it to finish. An
+	interrupt comes here from the loop, which we then leave: the
+	corpus isn't to be touched from a signal handler.
+*/
+void
+writerdone(int sig, short what, void *arg)
+{
+	int fl;
+
+	fl = fcntl(corpusfd, F_GETFL);
+	fcntl(corpusfd, F_SETFL, fl & ~O_NONBLOCK);
+	while(evbuffer_get_length(corpus) > 0){
+		if(evbuffer_write(corpus, corpusfd) < 0 && errno != EINTR)
+			break;
+	}
+	close(corpusfd);
+	waitpid(writerpid, nil, 0);
+	event_loopbreak();
+}
+
+/*
+	A record: a comment with the time the request's head was
+	complete, then the request as it came, and a newline to end
+	it. hplay skips the comments, and anything else that isn't a
+	request line.
+*/
+void
+recordhead(struct pconn *c, char *p, size_t n)
+{
+	int64_t ns;
+
+	counts.requests++;
+	c->drop = evbuffer_get_length(corpus) > Maxbacklog;
+	if(c->drop){
+		counts.dropped++;
+		return;
+	}
+
+	ns = realnsec();
+	evbuffer_add_printf(corpus, "# %lld.%06lld\n", (long long)(ns / 1000000000),
+	    (long long)(ns / 1000 % 1000000));
+	evbuffer_add(corpus, p, n);
+	counts.bytes += n;
+	event_add(&corpusev, nil);
+}
+
+/* Pass the next n bytes on to the upstream, recording them. */
+void
+take(struct pconn *c, size_t n)
+{
+	struct evbuffer_iovec v[16];
+	size_t left;
+	int i, k;
+
+	if(!c->drop){
+		k = evbuffer_peek(c->rq, n, nil, v, 16);
+		for(left = n, i = 0; i < k && i < 16 && left > 0; i++){
+			if(v[i].iov_len > left)
+				v[i].iov_len = left;
+			evbuffer_add(corpus, v[i].iov_base, v[i].iov_len);
+			left -= v[i].iov_len;
+		}
+		/* more pieces than we peeked at; rare enough to copy */
+		if(left > 0)
+			evbuffer_add(corpus, (char *)evbuffer_pullup(c->rq, n) + n - left, left);
+		counts.bytes += n;
+		event_add(&corpusev, nil);
+	}
+	evbuffer_remove_buffer(c->rq, c->srv.out, n);
+}
+
+/* The request ends here. */
+void
+endrequest(struct pconn *c)
+{
+	if(!c->drop)
+		evbuffer_add(corpus, "\n", 1);
+	c->state = Shead;
+}
+
+/* Is line (of length n) the header named hdr? then the value */
+char *
+hdrval(char *line, size_t n, char *hdr)
+{
+	size_t len = strlen(hdr);
+
+	if(n <= len || strncasecmp(line, hdr, len) != 0 || line[len] != ':')
+		return nil;
+	for(line += len+1, n -= len+1; n > 0 && *line == ' '; line++, n--);
+	return line;
+}
+
+/*
+	A request head of n bytes, at the front of c->rq. Find how its
+	body is framed; we follow Content-Length and chunked bodies,
+	and stop following at an upgrade, or at what isn't HTTP/1.
+*/
+void
+head(struct pconn *c, size_t n)
+{
+	char *p, *e, *line, *nl, *v;
+	size_t skip, len;
+
+	p = (char *)evbuffer_pullup(c->rq, n);
+	e = p + n;
+
+	/* clients may send a CRLF after a body; pass it on unrecorded */
+	for(skip=0; skip<n && (p[skip] == '\r' || p[skip] == '\n'); skip++);
+	if(skip == n){
+		evbuffer_remove_buffer(c->rq, c->srv.out, n);
+		return;
+	}
+	if(memcmp(p + skip, "PRI * HTTP/2", n - skip < 12 ? n - skip : 12) == 0 ||
+	    memchr(p + skip, ' ', n - skip) == nil){
+		c->state = Spass;
+		return;
+	}
+
+	c->state = Shead;
+	c->left = 0;
+	for(line = p + skip; (nl = memchr(line, '\n', e - line)) != nil; line = nl + 1){
+		len = nl - line;
+		if(len > 0 && line[len-1] == '\r')
+			len--;
+		if((v = hdrval(line, len, "Content-Length")) != nil){
+			c->left = strtoll(v, nil, 10);
+			if(c->left > 0)
+				c->state = Sbody;
+		}else if(hdrval(line, len, "Transfer-Encoding") != nil){
+			/* chunked is always the last coding */
+			if(len >= 7 && strncasecmp(line + len - 7, "chunked", 7) == 0)
+				c->state = Schunksize;
+		}else if(hdrval(line, len, "Upgrade") != nil)
+			c->state = Spass;
+	}
+
+	recordhead(c, p + skip, n - skip);
+	evbuffer_remove_buffer(c->rq, c->srv.out, n);
+
+	/* the upgraded stream is not ours to follow; the request was */
+	if(c->state == Spass && !c->drop)
+		evbuffer_add(corpus, "\n", 1);
+	else if(c->state == Shead)
+		endrequest(c);
+}
+
+/* Follow what the client has sent, passing it on as we go. */
+void
+follow(struct pconn *c)
+{
+	struct evbuffer_ptr p;
+	size_t n, eol;
+	char line[32];
+
+	for(;;) switch(c->state){
+	case Shead:
+		p = evbuffer_search(c->rq, "\r\n\r\n", 4, nil);
+		if(p.pos < 0){
+			if(evbuffer_get_length(c->rq) <= Maxhead && !c->cli.eof)
+				return;
+			c->state = Spass;
+			break;
+		}
+		head(c, p.pos + 4);
+		break;
+
+	case Sbody:
+	case Schunk:
+		if((n = evbuffer_get_length(c->rq)) == 0)
+			return;
+		if(n > c->left)
+			n = c->left;
+		take(c, n);
+		if((c->left -= n) > 0)
+			return;
+		if(c->state == Sbody)
+			endrequest(c);
+		else
+			c->state = Schunksize;
+		break;
+
+	case Schunksize:
+	case Strailers:
+		p = evbuffer_search_eol(c->rq, nil, &eol, EVBUFFER_EOL_CRLF);
+		if(p.pos < 0){
+			if(evbuffer_get_length(c->rq) > Maxline)
+				c->state = Spass;
+			else
+				return;
+			break;
+		}
+		n = p.pos;
+		if(c->state == Schunksize){
+			/* chunk data is followed by a CRLF; count it in */
+			evbuffer_copyout(c->rq, line, n < sizeof(line) - 1 ? n : sizeof(line) - 1);
+			line[n < sizeof(line) - 1 ? n : sizeof(line) - 1] = '\0';
+			c->left = strtoll(line, nil, 16);
+			c->state = c->left > 0 ? Schunk : Strailers;
+			c->left += 2;
+			take(c, n + eol);
+		}else{
+			take(c, n + eol);
+			if(n == 0)
+				endrequest(c);
+		}
+		break;
+
+	case Spass:
+		evbuffer_add_buffer(c->srv.out, c->rq);
+		return;
+	}
+}
+
+/*
+	Proxying. Each end's reads go to the other's out, and stop
+	while that is more than Maxpending behind. An end's EOF is
+	passed on once its data is, and the pair is closed when both
+	ways are done.
+*/
+
+void
+hangup(struct pconn *c)
+{
+	event_del(&c->cli.rev);
+	event_del(&c->cli.wev);
+	event_del(&c->srv.rev);
+	event_del(&c->srv.wev);
+	close(c->cli.fd);
+	close(c->srv.fd);
+	evbuffer_free(c->cli.out);
+	evbuffer_free(c->srv.out);
+	evbuffer_free(c->rq);
+	free(c);
+	counts.conns--;
+}
+
+/* s's out may have changed; o is the other end. */
+void
+pump(struct pconn *c, struct side *s, struct side *o)
+{
+	if(s == &c->srv && c->connecting)
+		return;
+	if(evbuffer_get_length(s->out) > 0){
+		event_add(&s->wev, nil);
+		return;
+	}
+
+	event_del(&s->wev);
+	if(o->eof && !s->shut){
+		shutdown(s->fd, SHUT_WR);
+		s->shut = 1;
+	}
+	if(c->cli.shut && c->srv.shut)
+		hangup(c);
+}
+
+void
+readcb(int fd, short what, void *arg)
+{
+	struct pconn *c = arg;
+	struct side *s, *o;
+	int n;
+
+	if(fd == c->cli.fd){
+		s = &c->cli;
+		o = &c->srv;
+		n = evbuffer_read(c->rq, fd, -1);
+	}else{
+		s = &c->srv;
+		o = &c->cli;
+		n = evbuffer_read(o->out, fd, -1);
+	}
+	if(n < 0 && (errno == EAGAIN || errno == EINTR))
+		return;
+	if(n < 0){
+		hangup(c);
+		return;
+	}
+	if(n == 0){
+		s->eof = 1;
+		event_del(&s->rev);
+	}
+
+	if(s == &c->cli)
+		follow(c);
+	if(evbuffer_get_length(o->out) > Maxpending)
+		event_del(&s->rev);
+	pump(c, o, s);
+}
+
+void
+writecb(int fd, short what, void *arg)
+{
+	struct pconn *c = arg;
+	struct side *s, *o;
+	int err;
+	socklen_t len;
+
+	if(fd == c->cli.fd){
+		s = &c->cli;
+		o = &c->srv;
+	}else{
+		s = &c->srv;
+		o = &c->cli;
+	}
+
+	if(s == &c->srv && c->connecting){
+		len = sizeof(err);
+		if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0){
+			counts.errors++;
+			hangup(c);
+			return;
+		}
+		c->connecting = 0;
+		event_add(&s->rev, nil);
+	}
+
+	if(evbuffer_write(s->out, fd) < 0 && errno != EAGAIN && errno != EINTR){
+		hangup(c);
+		return;
+	}
+
+	if(evbuffer_get_length(s->out) <= Maxpending && !o->eof)
+		event_add(&o->rev, nil);
+	pump(c, s, o);
+}
+
+void
+acceptcb(int lfd, short what, void *arg)
+{
+	struct pconn *c;
+	int fd, one = 1;
+
+	while((fd = accept(lfd, nil, nil)) >= 0){
+		evutil_make_socket_nonblocking(fd);
+		counts.accepts++;
+
+		if((c = calloc(1, sizeof(*c))) == nil)
+			panic("calloc");
+		c->cli.fd = fd;
+		if((c->srv.fd = netdial(&upstream)) < 0){
+			counts.errors++;
+			close(fd);
+			free(c);
+			continue;
+		}
+		if(upstream.ss_family != AF_UNIX)
+			setsockopt(c->srv.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		c->connecting = 1;
+		counts.conns++;
+
+		if((c->cli.out = evbuffer_new()) == nil ||
+		    (c->srv.out = evbuffer_new()) == nil ||
+		    (c->rq = evbuffer_new()) == nil)
+			panic("evbuffer_new");
+
+		event_set(&c->cli.rev, c->cli.fd, EV_READ|EV_PERSIST, readcb, c);
+		event_set(&c->cli.wev, c->cli.fd, EV_WRITE|EV_PERSIST, writecb, c);
+		event_set(&c->srv.rev, c->srv.fd, EV_READ|EV_PERSIST, readcb, c);
+		event_set(&c->srv.wev, c->srv.fd, EV_WRITE|EV_PERSIST, writecb, c);
+		event_add(&c->cli.rev, nil);
+		event_add(&c->srv.wev, nil);
+	}
+}
+
+void
+usage(char *cmd)
+{
+	panic("usage: %s [-i INTERVAL] -o CORPUS [HOST:]PORT|unix:PATH "
+	    "host|unix:PATH port", cmd);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct sockaddr_storage ss;
+	char *cmd = argv[0], *out = nil, *host, *p;
+	int ch, port, fd, one = 1;
+
+	while((ch = getopt(argc, argv, "i:o:h")) != -1){
+		switch(ch){
+		case 'i':
+			parseinterval(optarg, &reporttv);
+			break;
+		case 'o':
+			out = optarg;
+			break;
+		default:
+			usage(cmd);
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if(argc != 3 || out == nil)
+		usage(cmd);
+
+	port = atoi(argv[2]);
+	if(port == 0 && !isunix(argv[1]))
+		panic("invalid port \"%s\"", argv[2]);
+	netaddr(argv[1], port, &upstream);
+
+	/* where we listen: like hserve's, but any address will do */
+	host = "127.0.0.1";
+	port = 0;
+	if(isunix(argv[0]))
+		host = argv[0];
+	else{
+		if((p = strrchr(argv[0], ':')) != nil){
+			*p++ = '\0';
+			host = argv[0];
+		}else
+			p = argv[0];
+		if((port = atoi(p)) == 0)
+			panic("invalid port \"%s\"", p);
+	}
+	netaddr(host, port, &ss);
+	if((fd = netlisten(&ss)) < 0)
+		panic("failed to listen on %s", argv[0]);
+	if(ss.ss_family != AF_UNIX)
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	writer(out);
+
+	signal(SIGPIPE, SIG_IGN);
+
+	event_init();
+	signal_set(&intev, SIGINT, writerdone, nil);
+	signal_set(&termev, SIGTERM, writerdone, nil);
+	signal_add(&intev, nil);
+	signal_add(&termev, nil);
+	event_set(&corpusev, corpusfd, EV_WRITE|EV_PERSIST, corpuscb, nil);
+	event_set(&acceptev, fd, EV_READ|EV_PERSIST, acceptcb, nil);
+	event_add(&acceptev, nil);
+
+	if(isunix(argv[1]))
+		say("recording %s to %s", argv[1], out);
+	else
+		say("recording %s:%s to %s", argv[1], argv[2], out);
+	fprintf(stderr, "# ts\t\treqs\tconns\taccepts\terrors\tbytes\tdropped\thz\n");
+
+	lastreport = nsec();
+	event_set(&reportev, -1, EV_PERSIST, reportcb, nil);
+	evtimer_add(&reportev, &reporttv);
+
+	event_dispatch();
+	return 0;
+}
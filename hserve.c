@@ -1,49 +1,892 @@
+/*
+ * hserve - constant-response HTTP server with periodic output.
+ */
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <signal.h>
 #include <assert.h>
 #include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
 #include <event.h>
 #include <evhttp.h>
+#include <event2/bufferevent_ssl.h>
+#include <openssl/ssl.h>
 
 #include "u.h"
+#include "h2.h"
+#include "net.h"
+
+#define MAX_BUCKETS 100
 
 static void respond(struct evhttp_request *req, void *arg);
-char content[6*1024];
+char *content;
+size_t ncontent = 6*1024;
+SSL_CTX *tlsctx;	/* nil: cleartext */
+int h2c;		/* HTTP/2 with prior knowledge, instead of evhttp */
+
+struct{
+	int64_t buckets[MAX_BUCKETS];	/* service time, ns */
+	int nbuckets;
+}params;
+
+/*
+	Interval counters. They are only ever touched from the event
+	loop thread, so there is no locking: the loop owns them.
+*/
+struct{
+	int requests;
+	int64_t bytes;
+	int accepts;
+	int conns;		/* not reset; a gauge */
+	int counters[MAX_BUCKETS + 1];
+}counts;
+
+struct event	reportev;
+struct timeval	reporttv = { 1, 0 };
+int64_t		lastreport;
+
+/* per-fd: has this connection served a request yet? */
+char		*connfd;
+int		nconnfd;
+
+/*
+	Reporting.
+*/
+
+void
+reportcb(int fd, short what, void *arg)
+{
+	int i;
+	int64_t now, ns;
+
+	now = nsec();
+	ns = now - lastreport;
+	lastreport = now;
+
+	printts(&reporttv);
+	printf("%d\t", counts.requests);
+	printf("%lld\t", (long long)counts.bytes);
+	printf("%d\t", counts.conns);
+	printf("%d\t", counts.accepts);
+	for(i=0; i<params.nbuckets; i++)
+		printf("%d\t", counts.counters[i]);
+	printf("%d\t", counts.counters[i]);
+	printf("%d\n", ns > 0 ? (int)(counts.requests * 1000000000LL / ns) : 0);
+	fflush(stdout);
+
+	counts.requests = counts.accepts = 0;
+	counts.bytes = 0;
+	memset(counts.counters, 0, sizeof(counts.counters));
+}
+
+/*
+	Connection accounting. evhttp gives us no accept hook, but it
+	asks us for the bufferevent of every connection it accepts.
+*/
+
+static struct bufferevent *
+acceptcb(struct event_base *base, void *arg)
+{
+	SSL *ssl;
+
+	counts.accepts++;
+	if(tlsctx == nil)
+		return bufferevent_socket_new(base, -1, BEV_OPT_CLOSE_ON_FREE);
+
+	if((ssl = SSL_new(tlsctx)) == nil)
+		return nil;
+	return bufferevent_openssl_socket_new(base, -1, ssl,
+	    BUFFEREVENT_SSL_ACCEPTING, BEV_OPT_CLOSE_ON_FREE);
+}
+
+/*
+	TLS, with the server's default session cache and tickets, so
+	that clients may resume.
+*/
+void
+tlsinit(char *cert, char *key)
+{
+	if((tlsctx = SSL_CTX_new(TLS_server_method())) == nil)
+		panic("SSL_CTX_new");
+	if(SSL_CTX_use_certificate_chain_file(tlsctx, cert) != 1)
+		panic("%s: bad certificate", cert);
+	if(SSL_CTX_use_PrivateKey_file(tlsctx, key, SSL_FILETYPE_PEM) != 1)
+		panic("%s: bad key", key);
+	SSL_CTX_set_mode(tlsctx, SSL_MODE_RELEASE_BUFFERS);
+}
+
+static void
+closecb(struct evhttp_connection *evcon, void *arg)
+{
+	int fd = (int)(intptr_t)arg;
+
+	connfd[fd] = 0;
+	counts.conns--;
+}
+
+static void
+trackconn(struct evhttp_request *req)
+{
+	struct evhttp_connection *evcon;
+	int fd;
+
+	evcon = evhttp_request_get_connection(req);
+	fd = bufferevent_getfd(evhttp_connection_get_bufferevent(evcon));
+	if(fd < 0 || fd >= nconnfd || connfd[fd])
+		return;
+
+	connfd[fd] = 1;
+	counts.conns++;
+	evhttp_connection_set_closecb(evcon, closecb, (void *)(intptr_t)fd);
+}
+
+/*
+	h2c. evhttp has no HTTP/2, so this is a server of its own on
+	the same listener: prior knowledge only, the same reply, and the
+	same stats. Request headers are never decoded; a request is
+	complete at its END_STREAM. Replies go out as the client's flow
+	control windows allow.
+*/
+
+struct h2stream{
+	uint32_t id;
+	size_t off;		/* content sent */
+	int64_t window;
+	int64_t start;
+};
+
+struct h2conn{
+	int fd;
+	int preface;
+	int64_t window;		/* connection send window */
+	int64_t initwindow;	/* the client's, for new streams */
+	uint32_t cont;		/* ended stream whose header block continues */
+
+	struct h2stream *streams;	/* replies with content to go */
+	int nstreams, astreams;
+	int64_t *done;		/* starts of replies queued, not yet written */
+	int ndone, adone;
+
+	struct event rev;
+	struct event wev;
+	struct evbuffer *in;
+	struct evbuffer *out;
+};
+
+uint8_t		h2block[32];	/* :status 200, content-length */
+size_t		nh2block;
+struct event	h2acceptev;
+
+void
+h2blockinit()
+{
+	char len[24];
+	uint8_t *p = h2block;
+
+	snprintf(len, sizeof(len), "%zu", ncontent);
+	*p++ = 0x88;				/* :status 200 */
+	p += hpackint(p, 4, 0x00, 28);		/* content-length, not indexed */
+	p += hpackint(p, 7, 0, strlen(len));
+	memcpy(p, len, strlen(len));
+	nh2block = p + strlen(len) - h2block;
+}
+
+void
+h2srvclose(struct h2conn *h)
+{
+	event_del(&h->rev);
+	event_del(&h->wev);
+	close(h->fd);
+	evbuffer_free(h->in);
+	evbuffer_free(h->out);
+	free(h->streams);
+	free(h->done);
+	free(h);
+	counts.conns--;
+}
+
+void
+h2finish(struct h2conn *h, int64_t start)
+{
+	if(h->ndone == h->adone){
+		h->adone = h->adone ? 2*h->adone : 16;
+		h->done = remal(h->done, h->adone * sizeof(h->done[0]));
+	}
+	h->done[h->ndone++] = start;
+	counts.bytes += ncontent;
+}
+
+/* Send what the windows allow of the replies in progress. */
+void
+h2pump(struct h2conn *h)
+{
+	struct h2stream *s;
+	size_t n;
+	int i;
+
+	for(i=0; i<h->nstreams; ){
+		s = &h->streams[i];
+		while(s->off < ncontent && h->window > 0 && s->window > 0){
+			n = ncontent - s->off;
+			if(n > H2maxframe)
+				n = H2maxframe;
+			if(n > h->window)
+				n = h->window;
+			if(n > s->window)
+				n = s->window;
+			h2hdr(h->out, Tdata, s->off + n == ncontent ? Fendstream : 0, s->id, n);
+			evbuffer_add_reference(h->out, content + s->off, n, nil, nil);
+			s->off += n;
+			s->window -= n;
+			h->window -= n;
+		}
+		if(s->off < ncontent){
+			i++;
+			continue;
+		}
+		h2finish(h, s->start);
+		*s = h->streams[--h->nstreams];
+	}
+}
+
+void
+h2reply(struct h2conn *h, uint32_t id)
+{
+	struct h2stream *s;
+	int64_t start = nsec();
+
+	h2put(h->out, Theaders, Fendheaders | (ncontent == 0 ? Fendstream : 0),
+	    id, h2block, nh2block);
+	if(ncontent == 0){
+		h2finish(h, start);
+		return;
+	}
+
+	if(h->nstreams == h->astreams){
+		h->astreams = h->astreams ? 2*h->astreams : 16;
+		h->streams = remal(h->streams, h->astreams * sizeof(h->streams[0]));
+	}
+	s = &h->streams[h->nstreams++];
+	s->id = id;
+	s->off = 0;
+	s->window = h->initwindow;
+	s->start = start;
+}
+
+struct h2stream *
+h2find(struct h2conn *h, uint32_t id)
+{
+	int i;
+
+	for(i=0; i<h->nstreams; i++){
+		if(h->streams[i].id == id)
+			return &h->streams[i];
+	}
+	return nil;
+}
+
+/* Act on frame f, at the head of h->in; -1 hangs up. */
+int
+h2srvframe(struct h2conn *h, struct h2frame *f)
+{
+	struct h2stream *s;
+	uint8_t *p;
+	uint32_t v;
+	int64_t delta;
+	int i, j, id;
+
+	p = evbuffer_pullup(h->in, H2hdr + f->len) + H2hdr;
+
+	switch(f->type){
+	case Theaders:
+		if(f->sid == 0 || f->sid % 2 == 0)
+			return -1;
+		if(!(f->flags & Fendstream))
+			break;
+		if(f->flags & Fendheaders)
+			h2reply(h, f->sid);
+		else
+			h->cont = f->sid;
+		break;
+
+	case Tcont:
+		if((f->flags & Fendheaders) && f->sid == h->cont){
+			h2reply(h, f->sid);
+			h->cont = 0;
+		}
+		break;
+
+	case Tdata:
+		/* request bodies are dropped; keep them coming */
+		if(f->len > 0){
+			h2window(h->out, 0, f->len);
+			if(!(f->flags & Fendstream))
+				h2window(h->out, f->sid, f->len);
+		}
+		if(f->flags & Fendstream)
+			h2reply(h, f->sid);
+		break;
+
+	case Tsettings:
+		if(f->flags & Fack)
+			break;
+		if(f->len % 6 != 0)
+			return -1;
+		for(i=0; i<f->len; i+=6){
+			id = p[i]<<8 | p[i+1];
+			v = h2get32(p + i + 2);
+			if(id != Swindow)
+				continue;
+			delta = (int64_t)v - h->initwindow;
+			h->initwindow = v;
+			for(j=0; j<h->nstreams; j++)
+				h->streams[j].window += delta;
+		}
+		h2put(h->out, Tsettings, Fack, 0, nil, 0);
+		break;
+
+	case Twindow:
+		if(f->len != 4)
+			return -1;
+		v = h2get32(p) & 0x7fffffff;
+		if(f->sid == 0)
+			h->window += v;
+		else if((s = h2find(h, f->sid)) != nil)
+			s->window += v;
+		break;
+
+	case Trst:
+		if((s = h2find(h, f->sid)) != nil)
+			*s = h->streams[--h->nstreams];
+		break;
+
+	case Tping:
+		if(!(f->flags & Fack) && f->len == 8)
+			h2put(h->out, Tping, Fack, 0, p, 8);
+		break;
+	}
+
+	return 0;
+}
+
+/* The last byte of these replies is with the kernel: account them. */
+void
+h2flushed(struct h2conn *h)
+{
+	int i, j;
+	int64_t now = nsec();
+
+	for(j=0; j<h->ndone; j++){
+		for(i=0; i<params.nbuckets && params.buckets[i]<=now-h->done[j]; i++);
+		counts.counters[i]++;
+		counts.requests++;
+	}
+	h->ndone = 0;
+}
+
+void
+h2srvwrite(struct h2conn *h)
+{
+	if(evbuffer_write(h->out, h->fd) < 0 && errno != EAGAIN && errno != EINTR){
+		h2srvclose(h);
+		return;
+	}
+
+	if(evbuffer_get_length(h->out) > 0){
+		event_add(&h->wev, nil);
+		return;
+	}
+
+	event_del(&h->wev);
+	h2flushed(h);
+}
+
+void
+h2srvwritecb(int fd, short what, void *arg)
+{
+	h2srvwrite(arg);
+}
+
+void
+h2srvreadcb(int fd, short what, void *arg)
+{
+	struct h2conn *h = arg;
+	struct h2frame f;
+	int n;
+
+	n = evbuffer_read(h->in, fd, -1);
+	if(n < 0 && (errno == EAGAIN || errno == EINTR))
+		return;
+	if(n <= 0){
+		h2srvclose(h);
+		return;
+	}
+
+	if(!h->preface){
+		if(evbuffer_get_length(h->in) < H2npreface)
+			return;
+		if(memcmp(evbuffer_pullup(h->in, H2npreface), H2PREFACE, H2npreface) != 0){
+			h2srvclose(h);
+			return;
+		}
+		evbuffer_drain(h->in, H2npreface);
+		h->preface = 1;
+	}
+
+	while((n = h2next(h->in, &f)) != 0){
+		if(n < 0 || h2srvframe(h, &f) < 0){
+			h2srvclose(h);
+			return;
+		}
+		evbuffer_drain(h->in, H2hdr + f.len);
+	}
+
+	/* one write for everything this read brought on */
+	h2pump(h);
+	h2srvwrite(h);
+}
 
 void
-serve(char *host, short port)
+h2acceptcb(int lfd, short what, void *arg)
+{
+	struct h2conn *h;
+	int fd;
+
+	while((fd = accept(lfd, nil, nil)) >= 0){
+		evutil_make_socket_nonblocking(fd);
+		counts.accepts++;
+		counts.conns++;
+
+		if((h = calloc(1, sizeof(*h))) == nil)
+			panic("calloc");
+		h->fd = fd;
+		h->window = H2window;
+		h->initwindow = H2window;
+		if((h->in = evbuffer_new()) == nil || (h->out = evbuffer_new()) == nil)
+			panic("evbuffer_new");
+
+		/* our (empty) settings */
+		h2put(h->out, Tsettings, 0, 0, nil, 0);
+
+		event_set(&h->rev, fd, EV_READ|EV_PERSIST, h2srvreadcb, h);
+		event_set(&h->wev, fd, EV_WRITE|EV_PERSIST, h2srvwritecb, h);
+		event_add(&h->rev, nil);
+		h2srvwrite(h);
+	}
+}
+
+/*
+	Static files (-d). The tree is read once, at start: small files
+	into memory, packed together, and large ones kept open as file
+	segments, which libevent sends with sendfile (or maps, under
+	TLS). A request is then a hash lookup and a reference, with no
+	system calls of its own. Small files are not mapped one by one:
+	millions of mappings would run into vm.max_map_count.
+*/
+
+enum{
+	Smallfile = 64*1024,	/* larger ones are sent from the file */
+	Arena = 1<<20,		/* small files and paths are packed in these */
+	Maxetag = 48,
+};
+
+struct file{
+	char *path;		/* from the root, with its leading / */
+	size_t npath;
+	uint32_t hash;
+	struct file *next;	/* on the hash chain */
+	char *data;		/* a small file */
+	struct evbuffer_file_segment *seg;	/* a large one */
+	size_t n;
+	char *type;
+	char etag[Maxetag];
+};
+
+struct file	*files;
+int		nfiles, afiles;
+struct file	**filetab;	/* [mask+1] */
+uint32_t	filemask;
+char		*arenap;
+size_t		arenan;
+int64_t		nsmall;		/* bytes in memory */
+int		nlarge;
+
+struct{
+	char *ext;
+	char *type;
+}types[] = {
+	{".html",	"text/html"},
+	{".htm",	"text/html"},
+	{".css",	"text/css"},
+	{".js",		"application/javascript"},
+	{".json",	"application/json"},
+	{".txt",	"text/plain"},
+	{".xml",	"application/xml"},
+	{".svg",	"image/svg+xml"},
+	{".png",	"image/png"},
+	{".jpg",	"image/jpeg"},
+	{".jpeg",	"image/jpeg"},
+	{".gif",	"image/gif"},
+	{".webp",	"image/webp"},
+	{".ico",	"image/x-icon"},
+	{".woff2",	"font/woff2"},
+	{".wasm",	"application/wasm"},
+	{nil,		"application/octet-stream"},
+};
+
+/* FNV-1a */
+uint32_t
+pathhash(const char *p, size_t n)
+{
+	uint32_t h = 2166136261u;
+
+	while(n-- > 0){
+		h ^= (uint8_t)*p++;
+		h *= 16777619;
+	}
+	return h;
+}
+
+void *
+arena(size_t n)
+{
+	void *p;
+
+	if(n > arenan){
+		arenan = n > Arena ? n : Arena;
+		arenap = mal(arenan);
+	}
+	p = arenap;
+	arenap += n;
+	arenan -= n;
+	return p;
+}
+
+char *
+filetype(char *path)
+{
+	char *e;
+	int i;
+
+	if((e = strrchr(path, '.')) != nil && strchr(e, '/') == nil){
+		for(i=0; types[i].ext != nil; i++){
+			if(strcasecmp(e, types[i].ext) == 0)
+				break;
+		}
+	}else
+		for(i=0; types[i].ext != nil; i++);
+	return types[i].type;
+}
+
+struct file *
+newfile(char *path)
+{
+	struct file *f;
+
+	if(nfiles == afiles){
+		afiles = afiles ? 2*afiles : 1024;
+		files = remal(files, afiles * sizeof(files[0]));
+	}
+	f = &files[nfiles++];
+	memset(f, 0, sizeof(*f));
+	f->npath = strlen(path);
+	f->path = arena(f->npath + 1);
+	memcpy(f->path, path, f->npath + 1);
+	return f;
+}
+
+/* The file at dir/name, as path. */
+void
+loadfile(char *name, char *path)
+{
+	struct file *f, *g;
+	struct stat st;
+	char *slash;
+	int fd;
+
+	if((fd = open(name, O_RDONLY)) < 0 || fstat(fd, &st) < 0)
+		panic("%s: %s", name, strerror(errno));
+
+	f = newfile(path);
+	f->n = st.st_size;
+	f->type = filetype(path);
+	snprintf(f->etag, sizeof(f->etag), "\"%llx-%llx\"",
+	    (long long)st.st_mtime, (long long)st.st_size);
+
+	if(f->n > Smallfile){
+		/* the segment owns fd from here on */
+		if((f->seg = evbuffer_file_segment_new(fd, 0, f->n, 0)) == nil)
+			panic("%s: can't make a file segment", name);
+		nlarge++;
+	}else{
+		f->data = arena(f->n);
+		if(atomicio(read, fd, f->data, f->n) != f->n)
+			panic("%s: short read", name);
+		close(fd);
+		nsmall += f->n;
+	}
+
+	/* a directory's index.html is the directory's too */
+	slash = strrchr(path, '/');
+	if(strcmp(slash + 1, "index.html") == 0){
+		slash[1] = '\0';
+		g = newfile(path);
+		f = &files[nfiles - 2];	/* newfile may have moved it */
+		g->data = f->data;
+		g->seg = f->seg;
+		g->n = f->n;
+		g->type = f->type;
+		memcpy(g->etag, f->etag, sizeof(g->etag));
+	}
+}
+
+void
+walk(char *dir, char *path)
+{
+	DIR *d;
+	struct dirent *e;
+	struct stat st;
+	char *name, *sub;
+
+	if((d = opendir(dir)) == nil)
+		panic("%s: %s", dir, strerror(errno));
+
+	while((e = readdir(d)) != nil){
+		if(e->d_name[0] == '.')
+			continue;
+		name = mal(strlen(dir) + strlen(e->d_name) + 2);
+		sub = mal(strlen(path) + strlen(e->d_name) + 2);
+		sprintf(name, "%s/%s", dir, e->d_name);
+		sprintf(sub, "%s/%s", path, e->d_name);
+
+		if(e->d_type == DT_DIR)
+			walk(name, sub);
+		else if(e->d_type == DT_REG)
+			loadfile(name, sub);
+		else if(e->d_type == DT_UNKNOWN && stat(name, &st) == 0){
+			if(S_ISDIR(st.st_mode))
+				walk(name, sub);
+			else if(S_ISREG(st.st_mode))
+				loadfile(name, sub);
+		}
+		free(name);
+		free(sub);
+	}
+	closedir(d);
+}
+
+void
+loadfiles(char *root)
+{
+	struct file *f;
+	int i;
+
+	walk(root, "");
+	if(nfiles == 0)
+		panic("%s: no files", root);
+
+	for(filemask = 1; filemask < 2*nfiles; filemask <<= 1);
+	filemask--;
+	filetab = mal((filemask + 1) * sizeof(filetab[0]));
+	memset(filetab, 0, (filemask + 1) * sizeof(filetab[0]));
+	for(i=0; i<nfiles; i++){
+		f = &files[i];
+		f->hash = pathhash(f->path, f->npath);
+		f->next = filetab[f->hash & filemask];
+		filetab[f->hash & filemask] = f;
+	}
+
+	say("%d files from %s: %lld bytes in memory, %d sent from disk",
+	    nfiles, root, (long long)nsmall, nlarge);
+}
+
+struct file *
+lookup(const char *path, size_t n)
+{
+	struct file *f;
+	uint32_t h;
+
+	h = pathhash(path, n);
+	for(f = filetab[h & filemask]; f != nil; f = f->next){
+		if(f->hash == h && f->npath == n && memcmp(f->path, path, n) == 0)
+			return f;
+	}
+	return nil;
+}
+
+/*
+	A HEAD request gets the length a GET would, and no body:
+	evhttp would send the body all the same, and no length.
+*/
+int
+head(struct evhttp_request *req, size_t n)
+{
+	char buf[32];
+
+	if(evhttp_request_get_command(req) != EVHTTP_REQ_HEAD)
+		return 0;
+	snprintf(buf, sizeof(buf), "%zu", n);
+	evhttp_add_header(evhttp_request_get_output_headers(req), "Content-Length", buf);
+	return 1;
+}
+
+/*
+	The file the request's path names, as it came: there is no
+	percent-decoding, and the query is ignored. If-None-Match
+	with its ETag gets a 304.
+*/
+void
+respondfile(struct evhttp_request *req)
+{
+	struct evkeyvalq *hdrs;
+	struct evbuffer *buf;
+	struct file *f;
+	const char *uri, *inm;
+
+	uri = evhttp_request_get_uri(req);
+	if((f = lookup(uri, strcspn(uri, "?#"))) == nil){
+		evhttp_send_error(req, HTTP_NOTFOUND, nil);
+		return;
+	}
+
+	hdrs = evhttp_request_get_output_headers(req);
+	evhttp_add_header(hdrs, "Content-Type", f->type);
+	evhttp_add_header(hdrs, "ETag", f->etag);
+
+	inm = evhttp_find_header(evhttp_request_get_input_headers(req), "If-None-Match");
+	if(inm != nil && (strcmp(inm, "*") == 0 || strstr(inm, f->etag) != nil)){
+		evhttp_send_reply(req, HTTP_NOTMODIFIED, "Not Modified", nil);
+		return;
+	}
+	if(head(req, f->n)){
+		evhttp_send_reply(req, HTTP_OK, "OK", nil);
+		return;
+	}
+
+	buf = evbuffer_new();
+	/* sendfile only where the bytes go straight to the socket */
+	if(tlsctx == nil)
+		evbuffer_set_flags(buf, EVBUFFER_FLAG_DRAINS_TO_FD);
+	if(f->seg != nil)
+		evbuffer_add_file_segment(buf, f->seg, 0, f->n);
+	else
+		evbuffer_add_reference(buf, f->data, f->n, nil, nil);
+	counts.bytes += f->n;
+	evhttp_send_reply(req, HTTP_OK, "OK", buf);
+	evbuffer_free(buf);
+}
+
+/*
+	HTTP.
+*/
+
+void
+serve(char *host, int port)
 {
 	struct event_base *base;
 	struct evhttp *http;
-	struct evhttp_bound_socket *sock;
+	struct sockaddr_storage ss;
+	int fd, one = 1;
 
 	assert(host != nil);
-	assert(port != 0);
+
+	/* clients hang up on us mid-reply; that's their business */
+	signal(SIGPIPE, SIG_IGN);
 
 	base = event_init();
 	if(base == nil) panic("malloc");
 	http = evhttp_new(base);
 	if(http == nil) panic("malloc");
 
-	if(evhttp_bind_socket(http, host, port) != 0)
-		panic("failed to bind port %d", port);
+	netaddr(host, port, &ss);
+	if((fd = netlisten(&ss)) < 0)
+		panic("failed to listen on %s", host);
+	if(h2c){
+		h2blockinit();
+		event_set(&h2acceptev, fd, EV_READ|EV_PERSIST, h2acceptcb, nil);
+		event_add(&h2acceptev, nil);
+	}else if(evhttp_accept_socket_with_handle(http, fd) == nil)
+		panic("failed to listen on %s", host);
 
-	say("listening on %s:%d", host, port);
+	/*
+		Accepted sockets inherit this. Without it, large replies
+		stall on delayed ACKs and we measure the timer, not the server.
+	*/
+	if(ss.ss_family != AF_UNIX)
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
 
+	if(isunix(host))
+		say("listening on %s%s", host, tlsctx != nil ? " (tls)" : h2c ? " (h2c)" : "");
+	else
+		say("listening on %s:%d%s", host, port,
+		    tlsctx != nil ? " (tls)" : h2c ? " (h2c)" : "");
+
+	evhttp_set_bevcb(http, acceptcb, nil);
 	evhttp_set_gencb(http, respond, nil);
+
+	lastreport = nsec();
+	event_assign(&reportev, base, -1, EV_PERSIST, reportcb, nil);
+	evtimer_add(&reportev, &reporttv);
+
 	event_base_dispatch(base);
 }
 
+/*
+	Called once the last byte of the reply has been handed to the
+	kernel. The start time rides along in the callback argument so
+	that we don't need to allocate per-request state.
+*/
+static void
+donecb(struct evhttp_request *req, void *arg)
+{
+	int i;
+	int64_t ns;
+
+	ns = nsec() - (int64_t)(intptr_t)arg;
+	for(i=0; i<params.nbuckets && params.buckets[i]<=ns; i++);
+	counts.counters[i]++;
+	counts.requests++;
+}
+
 void
 respond(struct evhttp_request *req, void *arg)
 {
 	struct evbuffer *buf;
+
+	/*
+		evhttp parses the request in the same read callback that
+		received its bytes, so this is when the first byte was seen,
+		give or take the parsing.
+	*/
+	evhttp_request_set_on_complete_cb(req, donecb, (void *)(intptr_t)nsec());
+	trackconn(req);
+
+	if(files != nil){
+		respondfile(req);
+		return;
+	}
+
+	if(head(req, ncontent)){
+		evhttp_send_reply(req, HTTP_OK, "nectar", nil);
+		return;
+	}
+
 	buf = evbuffer_new();
-	evbuffer_add_reference(buf, content, sizeof(content), nil, nil);
+	evbuffer_add_reference(buf, content, ncontent, nil, nil);
+	counts.bytes += ncontent;
 	evhttp_send_reply(req, HTTP_OK, "nectar", buf);
 	evbuffer_free(buf);
 }
@@ -51,22 +894,112 @@ respond(struct evhttp_request *req, void *arg)
 void
 usage(char *name)
 {
-	panic("Usage: %s <port>", name);
+	panic("Usage: %s [-2] [-b BUCKETS] [-i INTERVAL] [-s SIZE] [-d DIR] [-c CERT [-k KEY]] "
+	    "<port|unix:PATH>", name);
 }
 
 int
 main(int argc, char **argv)
 {
-	char *end;
+	char *end, *sp, *ap, *host, *cert, *key, *root, *cmd = argv[0];
+	int ch, i, port;
+	struct rlimit rl;
+
+	/* Defaults, in milliseconds like hstress. */
+	params.buckets[0] = 1000000;
+	params.buckets[1] = 10000000;
+	params.buckets[2] = 100000000;
+	params.nbuckets = 3;
+	cert = key = root = nil;
+
+	while((ch = getopt(argc, argv, "2b:c:d:i:k:s:h")) != -1){
+		switch(ch){
+		case 'b':
+			/* fractional milliseconds are fine: server times are small */
+			sp = optarg;
+			memset(params.buckets, 0, sizeof(params.buckets));
+			for(i=0; i<MAX_BUCKETS && (ap=strsep(&sp, ",")) != nil; i++)
+				params.buckets[i] = (int64_t)(atof(ap) * 1000000);
+			params.nbuckets = i;
+
+			if(params.buckets[0] <= 0)
+				panic("first bucket must be >0");
+			for(i=1; i<params.nbuckets; i++){
+				if(params.buckets[i]<params.buckets[i-1])
+					panic("invalid bucket specification!");
+			}
+			break;
+
+		case 'i':
+			parseinterval(optarg, &reporttv);
+			break;
+
+		case 's':
+			ncontent = strtoul(optarg, nil, 10);
+			break;
+
+		case 'c':
+			cert = optarg;
+			break;
+
+		case 'd':
+			root = optarg;
+			break;
+
+		case '2':
+			h2c = 1;
+			break;
+
+		case 'k':
+			key = optarg;
+			break;
+
+		default:
+			usage(cmd);
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if(argc != 1) usage(cmd);
+
+	/* the key may be in with the certificate */
+	if(cert != nil)
+		tlsinit(cert, key != nil ? key : cert);
+	else if(key != nil)
+		usage(cmd);
+	if(h2c && tlsctx != nil)
+		panic("h2 is cleartext only: -2 and -c don't mix");
+	if(h2c && root != nil)
+		panic("-2 serves the constant reply only: -2 and -d don't mix");
+
+	host = "127.0.0.1";
+	port = 0;
+	if(isunix(argv[0]))
+		host = argv[0];
+	else{
+		port = strtoul(argv[0], &end, 10);
+		if(port == 0 || *end != '\0')
+			panic("Invalid port \"%s\"", argv[0]);
+	}
 
-	if(argc != 2) usage(argv[0]);
+	if(getrlimit(RLIMIT_NOFILE, &rl) < 0)
+		panic("getrlimit");
+	nconnfd = rl.rlim_cur == RLIM_INFINITY ? 1<<20 : rl.rlim_cur;
+	if((connfd = calloc(nconnfd, 1)) == nil)
+		panic("calloc");
 
-	int port = strtoul(argv[1], &end, 10);
-	if(port == 0 && (errno == EINVAL || errno == ERANGE))
-		panic("Invalid port \"%s\"", end);
+	content = mal(ncontent + 1);
+	memset(content, 'Z', ncontent);
+	if(root != nil)
+		loadfiles(root);
 
-	memset(content, 'Z', sizeof(content));
+	fprintf(stderr, "# ts\t\treqs\tbytes\tconns\taccepts\t");
+	for(i=0; i<params.nbuckets; i++)
+		fprintf(stderr, "<%g\t", params.buckets[i] / 1e6);
+	fprintf(stderr, ">=%g\thz\n", params.buckets[i - 1] / 1e6);
 
-	serve("127.0.0.1", port);
+	serve(host, port);
 	return 0;
 }
@@ -2,29 +2,80 @@
  * hstress - HTTP load generator with periodic output.
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE	/* sched_setaffinity */
+#endif
+
 #include <sys/types.h>
+#include <sys/queue.h>
+#include <sys/time.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/timerfd.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#include <sched.h>
+#endif
 #include <netinet/in.h>
-#include <netdb.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
 
 #include <signal.h>
+#include <fcntl.h>
+#include <time.h>
 #include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include <math.h>
 
 #include <event.h>
-#include <evhttp.h>
+#include <openssl/ssl.h>
 
 #include "u.h"
+#include "hist.h"
+#include "http.h"
+#include "h2.h"
+#include "net.h"
+#include "tmpl.h"
+#include "scen.h"
+#include "proc.h"
 
 #define NBUFFER 10
 #define MAX_BUCKETS 100
+#define MAX_SRCS 65536
+#define MAX_TARGETS 64
+#define MAX_SESSIONS 64		/* TLS sessions kept per target */
+#define NSTREAMHASH 64
+#define MAX_CPUS 256
+#define MAX_SLOW 64		/* -E: exemplars per interval */
+#define MAX_SIZES 32		/* -D: body sizes to sweep */
+
+/*
+	The loop lag probe fires every LAG_PERIOD; we call the generator
+	saturated when a worker is above SAT_CPU percent busy or its
+	probe fired more than SAT_LAG late.
+*/
+#define LAG_PERIOD	10000000LL	/* ns */
+#define SAT_LAG		5000000LL	/* ns */
+#define SAT_CPU		90
+
+#define PACE_PERIOD	1000000LL	/* ns; -R issues connects this often */
+#define HOLD_RAMP	10		/* -I opens this many per PACE_PERIOD */
+#define STREAM_BUF	(256*1024)	/* -S reads bodies this much at a time */
+#define RATE_BURST	10000000LL	/* ns; -U's rate saves up no more than this */
+
+/* -w auto: steady when this many intervals are within this of their mean */
+#define STEADY_WINDOW	5
+#define STEADY_CV	0.05
 
-char *http_hostname;
-uint16_t http_port;
-char http_hosthdr[2048];
+struct sockaddr_storage *srcs;
+int nsrcs;
+int nextsrc;
 
 struct{
 	int count;
@@ -32,23 +83,360 @@ struct{
 	int buckets[MAX_BUCKETS];
 	int nbuckets;
 	int rpc;
+
+	/* socket options */
+	int nodelay;
+	int linger;
+	int sndbuf;
+	int rcvbuf;
+	int busypoll;	/* SO_BUSY_POLL, us */
+
+	int balance;
+	int ab;		/* -B: compare the two targets */
+	int tsc;	/* time with the TSC */
+	int kts;	/* kernel timestamps, for kernel latency */
+	char path[1024];	/* a template for it; "" is / */
+	char scenario[1024];	/* -f: a file of steps, instead */
+	char method[16];	/* -m; "" is GET */
+	int64_t bodylo;		/* -d: body sizes, uniform over [lo, hi] */
+	int64_t bodyhi;
+	char bodyfile[1024];	/* -d @FILE: the body */
+	int64_t sizes[MAX_SIZES];	/* -D: body sizes, in turn */
+	int nsizes;
+	int cpus[MAX_CPUS];	/* to pin workers to; they spin */
+	int ncpus;
+
+	int tls;
+	double resume;	/* fraction of TLS handshakes that try to resume */
+
+	int crate;	/* -R: connects per second, per worker; 0 for requests */
+	int stream;	/* -S: read bodies around the evbuffers */
+	int checksum;	/* -X: check that bodies are all the same */
+	int slow;	/* -E: the slowest requests to show, per interval */
+	int hold;	/* -I: connections to hold, per worker */
+	double holdrate;	/* -I: and requests per second on them */
+
+	/* -w: the warm-up, left out of the summary */
+	int64_t warmup;	/* ns */
+	int warmreqs;
+	int warmsteady;	/* until the run is steady */
+
+	int streams;	/* h2c: streams per connection; 0 for HTTP/1.1 */
+	int window;	/* h2c: our receive window, stream and connection */
 }params;
 
+enum{	/* balancing policies */
+	Broundrobin,
+	Bweighted,
+	Bleast,
+};
+
 struct{
 	int successes;
 	int counters[MAX_BUCKETS + 1];
 	int errors;
 	int timeouts;
 	int closes;
+	int done;	/* worker: requests finished, any which way */
+
+	/* -R: errors, by kind; and connections the server never closed */
+	int refused;
+	int resets;
+	int unserved;
+
+	struct hist lat;
+
+	/* TLS */
+	int handshakes;
+	int resumed;
+	struct hist hs;
+
+	/* -J: from our request's send to the response's arrival */
+	struct hist klat;
+
+	int64_t rxbytes;
+	int64_t txbytes;
+	int mismatched;	/* -X: bodies unlike the target's first */
+
+	/* worker self-accounting, per interval */
+	int64_t maxlag;
+	int loops;
+	int callbacks;
+
+	int saturated;	/* parent: number of saturated intervals */
+	int held;	/* parent: -I connections at the last interval */
+	int64_t tcpu;	/* parent: -M, the target's CPU, ns */
+	int64_t tns;	/* parent: -M, over this long */
+	int64_t trss;	/* parent: -M, and its largest rss */
 }counts;
 
-struct request{
-	struct timeval 			starttv;
-	struct event			timeoutev;
-	int 					sock;
-	struct evhttp_connection *evcon;
-	struct evhttp_request	*evreq;
-	int					evcon_reqno;
+/* the parent's, while warming up */
+struct{
+	int intervals;
+	int requests;
+	int over;
+}warm;
+
+/*
+	Workers report to the parent over a socketpair as a stream of
+	records: a header followed by len bytes of payload. A worker
+	sends its histograms for interval n first, and the Rinterval
+	record last; that completes its part of the interval.
+*/
+
+enum{
+	Rinterval = 1,	/* struct interval */
+	Rlat,		/* struct histent[]: request latency */
+	Rbackend,	/* struct bstat for backend id */
+	Rblat,		/* struct histent[]: latency of backend id */
+	Rhs,		/* struct histent[]: TLS handshake time */
+	Rklat,		/* struct histent[]: kernel latency */
+	Rstep,		/* struct bstat for scenario step id */
+	Rslat,		/* struct histent[]: latency of step id */
+	Rslow,		/* struct slow[]: the worker's slowest requests */
+	Rsize,		/* struct bstat for -D size id */
+	Rzlat,		/* struct histent[]: latency of size id */
+};
+
+struct rec{
+	uint16_t type;
+	uint16_t id;
+	uint32_t n;
+	uint32_t len;
+};
+
+/*
+	-U: the parent passes changes on to the workers as ctl
+	messages, over the same sockets, the other way.
+*/
+enum{
+	Cconcurrency = 1,	/* v: loops, the worker's share */
+	Crate,		/* v: requests per second, likewise; 0 for no limit */
+	Cinterval,	/* v: seconds */
+	Cpause,
+	Cresume,
+};
+
+struct ctl{
+	int32_t op;
+	int32_t pad;
+	double v;
+};
+
+struct interval{
+	int32_t errors;
+	int32_t timeouts;
+	int32_t closes;
+	int32_t successes;
+	int32_t counters[MAX_BUCKETS + 1];
+	int32_t handshakes;
+	int32_t resumed;
+	int32_t refused;
+	int32_t resets;
+	int32_t unserved;
+	int32_t held;		/* -I: connections open at the end; a gauge */
+	int32_t mismatched;
+	int64_t rxbytes;
+	int64_t txbytes;
+	int64_t ns;		/* its length by the worker's clock; the longest */
+
+	/* the worker itself; aggregated as max, max, sum, sum */
+	int64_t maxlag;		/* ns */
+	int32_t cpu;		/* percent of one core */
+	int32_t loops;
+	int32_t callbacks;
+};
+
+/*
+	-E: one of an interval's slowest requests, with its phases:
+	connect, TLS handshake, until the request was written, until
+	the first byte of the response, and the rest. A phase the
+	request didn't have, or didn't get to, is 0.
+*/
+struct slow{
+	int64_t ns;
+	int64_t connect;
+	int64_t hs;
+	int64_t send;
+	int64_t wait;
+	int64_t recv;
+	int64_t bytes;		/* of the response, as read */
+	int32_t conn;		/* the worker's number for the connection */
+	int32_t reqno;		/* the request's, on the connection */
+	int16_t worker;
+	int16_t backend;
+	int16_t status;
+	int16_t how;
+};
+
+struct bstat{
+	int32_t successes;
+	int32_t errors;
+	int32_t timeouts;
+};
+
+/* per backend, in the parent */
+struct bslot{
+	struct bstat st;
+	struct hist lat;
+};
+
+/* the parent's view of an interval in progress */
+struct slot{
+	int nreport;
+	struct interval iv;
+	struct hist lat;
+	struct hist hs;
+	struct hist klat;
+	struct bslot *b;	/* [nbackends] */
+	struct bslot *s;	/* [scen->nsteps] */
+	struct bslot *z;	/* [params.nsizes] */
+	struct slow slow[MAX_SLOW];	/* a heap, the fastest on top */
+	int nslow;
+};
+
+/*
+	A target. The name and address are fixed at startup; the rest
+	is the worker's view of it, per interval, or the parent's
+	running totals.
+*/
+struct backend{
+	char name[256];		/* host:port */
+	char sni[256];		/* TLS server name, if host is one */
+	struct sockaddr_storage addr;
+	int weight;
+	char *req;		/* the request, with this Host: */
+	size_t nreq;
+
+	int cw;			/* current weight, for Bweighted */
+	int outstanding;
+	LIST_HEAD(, conn) idle;	/* keep-alive connections */
+	SSL_SESSION *sessions[MAX_SESSIONS];	/* to resume TLS with */
+	int nsessions;
+
+	LIST_HEAD(, h2) h2s;	/* h2c connections */
+	uint8_t h2req[300];	/* the h2 request's :authority, to be indexed */
+	size_t nh2req;
+	uint32_t h2entry;	/* the size of its :authority in HPACK's table */
+
+	uint64_t suma, sumb;	/* -X: the first body's checksum */
+	int summed;
+
+	int loops;		/* -U with -B: the loops running to it */
+	int parked;		/* -U: loops waiting to run, to it with -B */
+
+	struct bstat st;
+	struct hist lat;
+};
+
+struct backend	backends[MAX_TARGETS];
+int		nbackends;
+int		nextbackend;
+
+/* A connection, and the request outstanding on it. */
+struct conn{
+	struct backend *b;
+	LIST_ENTRY(conn) link;	/* on b->idle, or the free list */
+	int fd;
+	int connecting;
+	int state;
+	int reqno;		/* requests issued on this connection */
+	int64_t start;		/* ns, when the request was issued */
+	SSL *ssl;
+	int64_t hsstart;	/* ns, when the TLS handshake began */
+	int64_t txts;		/* kernel timestamps (wall clock ns) of the */
+	int64_t rxts;		/* request's send and the response's arrival */
+
+	/* an h2 stream, if h is set; it has no socket of its own */
+	struct h2 *h;
+	uint32_t sid;
+	int64_t unacked;	/* DATA not yet given back in WINDOW_UPDATE */
+
+	int64_t connns;		/* -R: how long the connect took */
+
+	/* -E: the connection's number, and when the request got where */
+	int id;
+	int64_t connected;
+	int64_t hsdone;
+	int64_t sent;
+	int64_t firstbyte;
+	int64_t rx;
+
+	int size;		/* -D: the body's, of params.sizes */
+
+	/* -f: the session's step, values, and what's kept to take them */
+	int step;
+	struct tmplvals *vals;
+	char *keep;
+	TAILQ_ENTRY(conn) plink;	/* on parked */
+
+	struct resp r;
+
+	struct event rev;
+	struct event wev;
+	struct event timeoutev;
+	struct evbuffer *in;
+	struct evbuffer *out;
+};
+
+/*
+	An h2c connection. Its streams are conns, hashed by stream id
+	on streams[]. Streams complete from inside h2readcb, and so
+	may close h; busy defers that until the callback is done.
+*/
+struct h2{
+	struct backend *b;
+	LIST_ENTRY(h2) link;	/* on b->h2s, while it takes new streams */
+	int fd;
+	int connecting;
+	int indexed;		/* the server has our :authority in its table */
+	int draining;		/* no new streams: GOAWAY, or -r is reached */
+	int busy;
+	int dead;
+	int reqno;
+	int nstreams;
+	uint32_t nextid;
+	uint32_t maxstreams;	/* the server's settings */
+	uint32_t tablesize;
+	int64_t unacked;
+	LIST_HEAD(, conn) streams[NSTREAMHASH];
+
+	struct event rev;
+	struct event wev;
+	struct evbuffer *in;
+	struct evbuffer *out;
+};
+
+/*
+	A held connection (-I). There are to be hundreds of thousands,
+	so it's no more than its event and a little state; a request
+	and its parser are lent to it while a response is due.
+*/
+struct holdreq{
+	struct holdreq *next;	/* on the free list */
+	struct evbuffer *in;
+	struct resp r;
+};
+
+struct hold{
+	struct event ev;	/* on its socket */
+	int state;
+	int busy;		/* its place on holdbusy, or -1 */
+	int64_t start;		/* ns, when the connect or request began */
+	struct holdreq *q;
+};
+
+enum{	/* hold states */
+	Hclosed,
+	Hconnecting,
+	Hidle,
+	Hbusy,
+};
+
+enum{	/* conn states */
+	Busy,
+	Failed,		/* could not connect */
+	Idle,		/* on b->idle */
 };
 
 enum{
@@ -59,22 +447,82 @@ enum{
 };
 
 struct event 	reportev;
+struct event	lagev;
+struct timeval	lagtv = { 0, LAG_PERIOD / 1000 };
+int64_t		lagnext;
 struct timeval 	reporttv ={ 1, 0 };
 struct timeval	timeouttv ={ 1, 0 };
-struct timeval	zerotv = {0,0};
-struct timeval 	lastreporttv;
+struct timeval	retrytv = { 0, 10000 };
+int64_t		lastreport;	/* worker: ns, when the interval began */
 int 			request_timeout;
-struct timeval 	ratetv;
+int64_t		startns;	/* parent: ns, when the run began */
 int 			ratecount = 0;
 int			nreport = 0;
-int 			nreportbuf[NBUFFER];
-int 			*reportbuf[NBUFFER];
+struct slot		slots[NBUFFER];
+struct histent		histents[Nhist];
 struct event_base *evbase;
+LIST_HEAD(, conn) freeconns;
+SSL_CTX		*tlsctx;
+struct tmpl	*reqpath;	/* from params.path */
+struct scen	*scen;		/* from params.scenario */
+struct bslot	*steps;		/* [scen->nsteps]: per interval, or the totals */
+struct bslot	*sizes;		/* [params.nsizes]: likewise */
+char		*payload;	/* -d, -D: bodies are references into it */
+size_t		npayload;
+int		nextsize;
+struct event	paceev;
+struct timeval	pacetv = { 0, PACE_PERIOD / 1000 };
+int64_t		pacestart;
+int		npaced;		/* connects issued */
+int		inflight;
+struct hold	*holds;		/* [params.hold] */
+int		*holdfree;	/* closed, to be opened */
+int		nholdfree;
+int		*holdbusy;	/* connecting, or with a request out */
+int		nholdbusy;
+int		nheld;		/* connected */
+int		holdover;	/* -n is reached */
+struct holdreq	*holdreqs;
+char		*streambuf;	/* -S: [STREAM_BUF] */
+struct slow	slows[MAX_SLOW];	/* -E: this interval's, a heap */
+int		nslows;
+int		nconnids;
+int		workerno;
+double		resumeacc;
+int		want;		/* loops to run: -c, until -U changes it */
+int		paused;
+double		qps;		/* -U: the request rate; 0 for none */
+double		tokens;
+int64_t		ratelast;
+struct event	rateev;
+struct event	ctlev;
+int		nparked;	/* loops waiting on the rate, or to resume */
+TAILQ_HEAD(, conn) parked = TAILQ_HEAD_INITIALIZER(parked);	/* -f: theirs */
+char		*ctlpath;	/* -U */
+char		*procspec;	/* -M: the target's pid, or cgroup */
+struct usage	procu;		/* -M: the last sample of it, */
+int64_t		procns;		/* and when */
+
+/* the parent's, for -U: the settings, and the last interval */
+struct{
+	int *sockets;
+	int nw;			/* workers */
+	int running;
+	int concurrency;	/* in all */
+	double rate;
+	int paused;
+	int hz;
+	double p50;
+	double p99;
+}live;
 
-void recvcb(struct evhttp_request *req, void *arg);
+void readcb(int fd, short what, void *arg);
+void writecb(int fd, short what, void *arg);
 void timeoutcb(int fd, short what, void *arg);
-struct evhttp_connection *mkhttp();
-void closecb(struct evhttp_connection *evcon, void *arg);
+void h2dispatch(struct conn *c);
+void h2end(struct conn *c);
+void h2cancel(struct conn *c);
+void h2close(struct h2 *h);
 void report();
 void sigint(int which);
 
@@ -82,349 +530,3656 @@ void sigint(int which);
 	Reporting.
 */
 
-int
-mkrate(struct timeval *tv, int count)
+/* count over ns, per second */
+int
+mkrate(int64_t ns, int count)
+{
+	if(ns <= 0)
+		return(0);
+	return(count * 1000000000LL / ns);
+}
+
+void
+sendrec(int type, int id, int n, void *p, size_t len)
+{
+	struct rec r;
+
+	r.type = type;
+	r.id = id;
+	r.n = n;
+	r.len = len;
+	if(atomicio(write, STDOUT_FILENO, &r, sizeof(r)) != sizeof(r) ||
+	    atomicio(write, STDOUT_FILENO, p, len) != len)
+		panic("report write");
+}
+
+/*
+	Our own CPU use since the last call, in percent of one core.
+*/
+int
+selfcpu()
+{
+	static int64_t lastwall, lastcpu;
+	struct rusage ru;
+	int64_t wall, cpu;
+	int pct;
+
+	if(getrusage(RUSAGE_SELF, &ru) < 0)
+		panic("getrusage");
+
+	wall = nsec();
+	cpu = (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000LL +
+	    (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000LL;
+
+	pct = wall > lastwall ? 100 * (cpu - lastcpu) / (wall - lastwall) : 0;
+	lastwall = wall;
+	lastcpu = cpu;
+
+	return pct;
+}
+
+/*
+	Fires every LAG_PERIOD. How late it runs is how long ready
+	events wait behind everything else the loop is doing. On Linux
+	the probe is a timerfd: libevent's own timers are only as
+	precise as the poll timeout, which can be off by milliseconds.
+*/
+void
+lagcb(int fd, short what, void *arg)
+{
+	int64_t now;
+#ifdef __linux__
+	uint64_t n;
+#endif
+
+	counts.callbacks++;
+	now = nsec();
+
+#ifdef __linux__
+	/* the timer is periodic: n expirations since we last looked */
+	if(read(fd, &n, sizeof(n)) == sizeof(n) && n > 1)
+		lagnext += (n - 1) * LAG_PERIOD;
+#endif
+
+	if(now - lagnext > counts.maxlag)
+		counts.maxlag = now - lagnext;
+
+#ifdef __linux__
+	lagnext += LAG_PERIOD;
+#else
+	lagnext = now + LAG_PERIOD;
+	evtimer_add(&lagev, &lagtv);
+#endif
+}
+
+void
+startlag()
+{
+#ifdef __linux__
+	struct itimerspec its;
+	int fd;
+
+	if((fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC)) < 0)
+		panic("timerfd_create");
+
+	lagnext = nsec() + LAG_PERIOD;
+	its.it_value.tv_sec = lagnext / 1000000000;
+	its.it_value.tv_nsec = lagnext % 1000000000;
+	its.it_interval.tv_sec = 0;
+	its.it_interval.tv_nsec = LAG_PERIOD;
+	if(timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, nil) < 0)
+		panic("timerfd_settime");
+
+	event_set(&lagev, fd, EV_READ|EV_PERSIST, lagcb, nil);
+	event_add(&lagev, nil);
+#else
+	lagnext = nsec() + LAG_PERIOD;
+	evtimer_set(&lagev, lagcb, nil);
+	evtimer_add(&lagev, &lagtv);
+#endif
+}
+
+/* -P: worker i gets the i-th of the CPUs, to itself if all goes well */
+void
+pin(int i)
+{
+#ifdef __linux__
+	cpu_set_t set;
+	int cpu = params.cpus[i % params.ncpus];
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if(sched_setaffinity(0, sizeof(set), &set) < 0)
+		panic("pin to cpu %d: %s", cpu, strerror(errno));
+#endif
+}
+
+/*
+	A pinned worker polls its loop instead of sleeping in the
+	kernel, so that it is already running when an event comes in.
+	Only the iterations that did something count.
+*/
+void
+spin()
+{
+	int n;
+
+	for(;;){
+		n = counts.callbacks;
+		if(event_base_loop(evbase, EVLOOP_NONBLOCK) != 0)
+			break;
+		if(counts.callbacks != n)
+			counts.loops++;
+	}
+}
+
+void
+reportcb(int fd, short what, void *arg)
+{
+	struct interval iv;
+	struct backend *b;
+	int64_t now;
+	int i, n;
+
+	n = histpack(&counts.lat, histents);
+	sendrec(Rlat, 0, nreport, histents, n * sizeof(histents[0]));
+	histclear(&counts.lat);
+
+	if(params.tls){
+		n = histpack(&counts.hs, histents);
+		sendrec(Rhs, 0, nreport, histents, n * sizeof(histents[0]));
+		histclear(&counts.hs);
+	}
+
+	if(params.kts){
+		n = histpack(&counts.klat, histents);
+		sendrec(Rklat, 0, nreport, histents, n * sizeof(histents[0]));
+		histclear(&counts.klat);
+	}
+
+	/* with one backend, these would be the totals again */
+	for(i=0; i<nbackends && nbackends>1; i++){
+		b = &backends[i];
+		n = histpack(&b->lat, histents);
+		sendrec(Rblat, i, nreport, histents, n * sizeof(histents[0]));
+		sendrec(Rbackend, i, nreport, &b->st, sizeof(b->st));
+		histclear(&b->lat);
+		memset(&b->st, 0, sizeof(b->st));
+	}
+
+	for(i=0; scen != nil && i<scen->nsteps; i++){
+		n = histpack(&steps[i].lat, histents);
+		sendrec(Rslat, i, nreport, histents, n * sizeof(histents[0]));
+		sendrec(Rstep, i, nreport, &steps[i].st, sizeof(steps[i].st));
+		histclear(&steps[i].lat);
+		memset(&steps[i].st, 0, sizeof(steps[i].st));
+	}
+
+	for(i=0; i<params.nsizes; i++){
+		n = histpack(&sizes[i].lat, histents);
+		sendrec(Rzlat, i, nreport, histents, n * sizeof(histents[0]));
+		sendrec(Rsize, i, nreport, &sizes[i].st, sizeof(sizes[i].st));
+		histclear(&sizes[i].lat);
+		memset(&sizes[i].st, 0, sizeof(sizes[i].st));
+	}
+
+	if(params.slow > 0){
+		sendrec(Rslow, 0, nreport, slows, nslows * sizeof(slows[0]));
+		nslows = 0;
+	}
+
+	memset(&iv, 0, sizeof(iv));
+	iv.errors = counts.errors;
+	iv.timeouts = counts.timeouts;
+	iv.closes = counts.closes;
+	for(i=0; i<=params.nbuckets; i++){
+		iv.counters[i] = counts.counters[i];
+		iv.successes += counts.counters[i];
+	}
+	iv.handshakes = counts.handshakes;
+	iv.resumed = counts.resumed;
+	iv.refused = counts.refused;
+	iv.resets = counts.resets;
+	iv.unserved = counts.unserved;
+	iv.held = nheld;
+	iv.mismatched = counts.mismatched;
+	iv.rxbytes = counts.rxbytes;
+	iv.txbytes = counts.txbytes;
+	now = nsec();
+	iv.ns = now - lastreport;
+	lastreport = now;
+	iv.maxlag = counts.maxlag;
+	iv.cpu = selfcpu();
+	iv.loops = counts.loops;
+	iv.callbacks = counts.callbacks;
+	sendrec(Rinterval, 0, nreport++, &iv, sizeof(iv));
+
+	counts.errors = counts.timeouts = counts.closes = 0;
+	counts.handshakes = counts.resumed = 0;
+	counts.refused = counts.resets = counts.unserved = 0;
+	counts.mismatched = 0;
+	counts.rxbytes = counts.txbytes = 0;
+	counts.maxlag = 0;
+	counts.loops = counts.callbacks = 0;
+	memset(counts.counters, 0, sizeof(counts.counters));
+}
+
+/*
+	HTTP. We speak just enough HTTP/1.1 ourselves, directly on
+	nonblocking sockets: that way we set up each socket before it
+	connects, the target is resolved once, and a request costs no
+	allocation. Only one request is outstanding per connection.
+*/
+
+/* set the socket options we were asked for */
+void
+sockopts(int fd, int family)
+{
+	static int warned;
+	int one = 1, flags;
+	struct linger l;
+
+	if(params.nodelay && family != AF_UNIX)
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	if(params.linger){
+		/* close with a RST: no TIME_WAIT left behind */
+		l.l_onoff = 1;
+		l.l_linger = 0;
+		setsockopt(fd, SOL_SOCKET, SO_LINGER, &l, sizeof(l));
+	}
+	if(params.sndbuf > 0)
+		setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &params.sndbuf, sizeof(params.sndbuf));
+	if(params.rcvbuf > 0)
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &params.rcvbuf, sizeof(params.rcvbuf));
+#ifdef __linux__
+	if(params.busypoll > 0 &&
+	    setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &params.busypoll, sizeof(params.busypoll)) < 0 &&
+	    !warned++)
+		fprintf(stderr, "# busypoll: %s\n", strerror(errno));
+	if(params.kts && family != AF_UNIX){
+		flags = SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_RX_SOFTWARE |
+		    SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_OPT_TSONLY;
+		setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+	}
+#endif
+}
+
+/*
+	Start connecting c. With source addresses, bind to the next one
+	in turn. IP_BIND_ADDRESS_NO_PORT defers picking the local port to
+	connect(), so a port is only taken per 4-tuple instead of per
+	source address.
+*/
+int
+dialfd(struct backend *b)
+{
+	int fd, one = 1;
+	struct sockaddr_storage *src, *dst = &b->addr;
+
+	fd = socket(dst->ss_family, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+	if(fd < 0)
+		return -1;
+
+	sockopts(fd, dst->ss_family);
+
+	if(nsrcs > 0 && dst->ss_family != AF_UNIX){
+		src = &srcs[nextsrc++ % nsrcs];
+#ifdef IP_BIND_ADDRESS_NO_PORT
+		setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &one, sizeof(one));
+#endif
+		if(bind(fd, (struct sockaddr *)src, sslen(src)) < 0){
+			close(fd);
+			return -1;
+		}
+	}
+
+	if(connect(fd, (struct sockaddr *)dst, sslen(dst)) < 0 &&
+	    errno != EINPROGRESS){
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int
+dial(struct conn *c)
+{
+	int fd;
+
+	if((fd = dialfd(c->b)) < 0)
+		return -1;
+
+	c->fd = fd;
+	c->connecting = 1;
+	c->reqno = 0;
+	c->id = ++nconnids;
+	event_assign(&c->rev, evbase, fd, EV_READ|EV_PERSIST, readcb, c);
+	event_assign(&c->wev, evbase, fd, EV_WRITE|EV_PERSIST, writecb, c);
+	event_add(&c->rev, nil);
+
+	return 0;
+}
+
+void
+hangup(struct conn *c)
+{
+	if(c->fd < 0)
+		return;
+
+	event_del(&c->rev);
+	event_del(&c->wev);
+	if(c->ssl != nil){
+		/* no close_notify; but don't let that spoil the session */
+		SSL_set_shutdown(c->ssl, SSL_SENT_SHUTDOWN|SSL_RECEIVED_SHUTDOWN);
+		SSL_free(c->ssl);
+		c->ssl = nil;
+	}
+	close(c->fd);
+	c->fd = -1;
+	counts.closes++;
+
+	evbuffer_drain(c->in, evbuffer_get_length(c->in));
+	evbuffer_drain(c->out, evbuffer_get_length(c->out));
+}
+
+/* A new, unconnected, conn to b. They're recycled. */
+struct conn *
+mkconn(struct backend *b)
+{
+	struct conn *c;
+
+	if((c = LIST_FIRST(&freeconns)) != nil)
+		LIST_REMOVE(c, link);
+	else{
+		if((c = calloc(1, sizeof(*c))) == nil)
+			panic("calloc");
+		c->fd = -1;
+		if((c->in = evbuffer_new()) == nil || (c->out = evbuffer_new()) == nil)
+			panic("evbuffer_new");
+		evtimer_set(&c->timeoutev, timeoutcb, c);
+		if(scen != nil){
+			c->vals = mal(sizeof(*c->vals));
+			c->keep = mal(Maxkeep);
+		}
+	}
+
+	c->b = b;
+	c->step = 0;
+	return c;
+}
+
+void
+freeconn(struct conn *c)
+{
+	hangup(c);
+	evtimer_del(&c->timeoutev);
+	LIST_INSERT_HEAD(&freeconns, c, link);
+}
+
+/*
+	Choose the backend for the next request. Outstanding counts,
+	and so Bleast, are per worker.
+*/
+struct backend *
+pick()
+{
+	struct backend *b, *best;
+	int i, total;
+
+	if(nbackends == 1)
+		return &backends[0];
+
+	switch(params.balance){
+	case Bweighted:
+		/* smooth weighted round robin, as in nginx */
+		best = nil;
+		for(i=0, total=0; i<nbackends; i++){
+			b = &backends[i];
+			b->cw += b->weight;
+			total += b->weight;
+			if(best == nil || b->cw > best->cw)
+				best = b;
+		}
+		best->cw -= total;
+		return best;
+
+	case Bleast:
+		/* fewest outstanding per unit of weight; ties rotate */
+		best = nil;
+		for(i=0; i<nbackends; i++){
+			b = &backends[(nextbackend + i) % nbackends];
+			if(best == nil ||
+			    b->outstanding * best->weight < best->outstanding * b->weight)
+				best = b;
+		}
+		nextbackend++;
+		return best;
+
+	default:
+		return &backends[nextbackend++ % nbackends];
+	}
+}
+
+/*
+	The request with a path from the template, straight into c->out:
+	b->req is the request for /, so its tail follows the path.
+*/
+void
+fillreq(struct conn *c)
+{
+	struct evbuffer_iovec v;
+	struct backend *b = c->b;
+	char *p;
+
+	if(evbuffer_reserve_space(c->out, 4 + reqpath->max + b->nreq, &v, 1) < 1)
+		panic("evbuffer_reserve_space");
+	p = v.iov_base;
+	memcpy(p, "GET ", 4);
+	p += 4;
+	p += tmplfill(reqpath, p);
+	memcpy(p, b->req + 5, b->nreq - 5);
+	v.iov_len = p + b->nreq - 5 - (char *)v.iov_base;
+	evbuffer_commit_space(c->out, &v, 1);
+}
+
+/*
+	-f: the request for c's step, likewise: b->req's Host and
+	whatever else follow the step's method and path, then its
+	headers and body.
+*/
+void
+fillstep(struct conn *c)
+{
+	static char *body;
+	static size_t nbody;
+	struct evbuffer_iovec v;
+	struct backend *b = c->b;
+	struct step *st = &scen->steps[c->step];
+	char *p;
+	size_t n, max;
+
+	c->r.head = st->head;
+	n = 0;
+	if(st->body != nil){
+		if(st->body->max > nbody){
+			nbody = st->body->max;
+			body = remal(body, nbody);
+		}
+		n = tmplfillv(st->body, body, c->vals);
+	}
+
+	max = st->line->max + b->nreq + st->hdrs->max + 40 + n;
+	if(evbuffer_reserve_space(c->out, max, &v, 1) < 1)
+		panic("evbuffer_reserve_space");
+	p = v.iov_base;
+	p += tmplfillv(st->line, p, c->vals);
+	memcpy(p, b->req + 5, b->nreq - 7);
+	p += b->nreq - 7;
+	p += tmplfillv(st->hdrs, p, c->vals);
+	if(st->body != nil)
+		p += sprintf(p, "Content-Length: %zu\r\n", n);
+	memcpy(p, "\r\n", 2);
+	p += 2;
+	if(n > 0)
+		memcpy(p, body, n);
+	v.iov_len = p + n - (char *)v.iov_base;
+	evbuffer_commit_space(c->out, &v, 1);
+}
+
+/*
+	-m, -d, -D: the request with another method, or a body. The
+	head goes into c->out, as in fillreq; the body is a reference
+	into the payload, which all requests share, so it is never
+	copied on our side of the socket.
+*/
+void
+fillbody(struct conn *c)
+{
+	struct evbuffer_iovec v;
+	struct backend *b = c->b;
+	char *p;
+	size_t n;
+
+	n = 0;
+	if(params.nsizes > 0){
+		c->size = nextsize++ % params.nsizes;
+		n = params.sizes[c->size];
+	}else if(params.bodyhi > 0)
+		n = params.bodylo + random() % (params.bodyhi - params.bodylo + 1);
+
+	if(evbuffer_reserve_space(c->out, sizeof(params.method) +
+	    (reqpath != nil ? reqpath->max : 1) + b->nreq + 40, &v, 1) < 1)
+		panic("evbuffer_reserve_space");
+	p = v.iov_base;
+	p += sprintf(p, "%s ", params.method[0] != '\0' ? params.method : "GET");
+	if(reqpath != nil)
+		p += tmplfill(reqpath, p);
+	else
+		*p++ = '/';
+	memcpy(p, b->req + 5, b->nreq - 7);
+	p += b->nreq - 7;
+	if(n > 0 || strcmp(params.method, "POST") == 0 || strcmp(params.method, "PUT") == 0)
+		p += sprintf(p, "Content-Length: %zu\r\n", n);
+	memcpy(p, "\r\n", 2);
+	v.iov_len = p + 2 - (char *)v.iov_base;
+	evbuffer_commit_space(c->out, &v, 1);
+
+	if(n > 0)
+		evbuffer_add_reference(c->out, payload, n, nil, nil);
+}
+
+/* Issue the next request on c, (re)connecting first if need be. */
+void
+dispatch(struct conn *c)
+{
+	c->b->outstanding++;
+
+	if(c->fd < 0 && dial(c) < 0){
+		/*
+			Most likely out of fds or ports; report the error
+			from the timer, so that we don't spin.
+		*/
+		c->state = Failed;
+		c->start = nsec();
+		evtimer_add(&c->timeoutev, &retrytv);
+		return;
+	}
+
+	c->reqno++;
+	c->state = Busy;
+	respinit(&c->r);
+	c->r.sum = params.checksum;
+	if(scen != nil && scen->steps[c->step].ntakes > 0){
+		c->r.keep = c->keep;
+		c->r.akeep = Maxkeep;
+	}
+	c->start = nsec();
+	c->txts = c->rxts = 0;
+	c->connected = c->hsdone = c->sent = c->firstbyte = 0;
+	c->rx = 0;
+	evtimer_add(&c->timeoutev, &timeouttv);
+
+	c->r.head = strcmp(params.method, "HEAD") == 0;
+	if(scen != nil)
+		fillstep(c);
+	else if(payload != nil || params.method[0] != '\0')
+		fillbody(c);
+	else if(reqpath != nil)
+		fillreq(c);
+	else
+		evbuffer_add_reference(c->out, c->b->req, c->b->nreq, nil, nil);
+	event_add(&c->wev, nil);
+}
+
+/* Start another request to b, on an idle connection if there is one. */
+void
+issueto(struct backend *b)
+{
+	struct conn *c;
+
+	if(params.streams > 0){
+		h2dispatch(mkconn(b));
+		return;
+	}
+
+	if((c = LIST_FIRST(&b->idle)) != nil)
+		LIST_REMOVE(c, link);
+	else
+		c = mkconn(b);
+
+	dispatch(c);
+}
+
+void
+issue()
+{
+	issueto(pick());
+}
+
+/* A request to b succeeded, in ns. */
+void
+success(struct backend *b, int64_t ns)
+{
+	int i;
+	long milliseconds;
+
+	histadd(&counts.lat, ns);
+	milliseconds = ns / 1000000;
+	for(i=0; params.buckets[i]<milliseconds &&
+	    params.buckets[i]!=0; i++);
+	counts.counters[i]++;
+	counts.successes++;
+	if(nbackends > 1){
+		histadd(&b->lat, ns);
+		b->st.successes++;
+	}
+}
+
+/*
+	-E: the slowest requests are kept on a heap with the fastest
+	of them on top, so a request that is faster still, as most
+	are, costs a comparison.
+*/
+void
+slowpush(struct slow *h, int *n, struct slow *s)
+{
+	struct slow t;
+	int i, k;
+
+	if(*n < params.slow){
+		/* sift up */
+		for(i = (*n)++; i > 0 && h[(i-1)/2].ns > s->ns; i = (i-1)/2)
+			h[i] = h[(i-1)/2];
+		h[i] = *s;
+		return;
+	}
+	if(s->ns <= h[0].ns)
+		return;
+
+	/* replace the top, and sift it down */
+	t = *s;
+	for(i=0; (k = 2*i + 1) < *n; i = k){
+		if(k+1 < *n && h[k+1].ns < h[k].ns)
+			k++;
+		if(h[k].ns >= t.ns)
+			break;
+		h[i] = h[k];
+	}
+	h[i] = t;
+}
+
+/* c's request, done how in ns, is among the slowest yet */
+void
+slowadd(struct conn *c, int how, int64_t ns)
+{
+	struct slow s;
+	int64_t end = c->start + ns, from;
+
+	memset(&s, 0, sizeof(s));
+	s.ns = ns;
+	from = c->start;
+	if(c->connected > 0){
+		s.connect = c->connected - from;
+		from = c->connected;
+	}
+	if(c->hsdone > 0){
+		s.hs = c->hsdone - from;
+		from = c->hsdone;
+	}
+	if(c->sent > 0){
+		s.send = c->sent - from;
+		from = c->sent;
+	}
+	if(c->firstbyte > 0){
+		s.wait = c->firstbyte - from;
+		s.recv = end - c->firstbyte;
+	}
+	s.bytes = c->rx;
+	s.conn = c->id;
+	s.reqno = c->reqno;
+	s.worker = workerno;
+	s.backend = c->b - backends;
+	s.status = c->r.code;
+	s.how = how;
+	slowpush(slows, &nslows, &s);
+}
+
+/* -D: per body size */
+void
+sizedone(struct conn *c, int how, int64_t ns)
+{
+	struct bslot *s = &sizes[c->size];
+
+	switch(how){
+	case Success:
+		histadd(&s->lat, ns);
+		s->st.successes++;
+		break;
+	case Error:
+		s->st.errors++;
+		break;
+	case Timeout:
+		s->st.timeouts++;
+		break;
+	}
+}
+
+/*
+	-f: c's step is done, how; on to the next, or, if it failed,
+	back to the first. A session keeps to its connection, or to
+	the one that replaces it, so there is no going idle.
+*/
+void
+stepdone(struct conn *c, int how, int64_t ns)
+{
+	struct bslot *s = &steps[c->step];
+
+	switch(how){
+	case Success:
+		histadd(&s->lat, ns);
+		s->st.successes++;
+		c->step = (c->step + 1) % scen->nsteps;
+		return;
+	case Error:
+		s->st.errors++;
+		break;
+	case Timeout:
+		s->st.timeouts++;
+		break;
+	}
+	c->step = 0;
+}
+
+/*
+	Live control (-U). Each of the -c loops runs a request after
+	the one before, until the parent changes their number, pauses
+	them or sets a rate: then loops end as their requests finish,
+	or are parked until the pause, or the rate, lets them go. A
+	parked loop is only the backend it was to run to (-B), or its
+	session's conn (-f).
+*/
+
+/* whether a loop to b is one too many */
+int
+toomany(struct backend *b)
+{
+	if(params.ab)
+		return b->loops > want/2;
+	return params.concurrency > want;
+}
+
+/* end a loop to b; c is its session's conn, if any */
+void
+retire(struct conn *c, struct backend *b)
+{
+	params.concurrency--;
+	if(params.ab)
+		b->loops--;
+	if(c != nil)
+		freeconn(c);
+}
+
+/* run the loop on: c's next step, or another request */
+void
+proceed(struct conn *c, struct backend *b)
+{
+	if(scen != nil)
+		dispatch(c);
+	else if(params.ab)
+		issueto(b);
+	else
+		issue();
+}
+
+/* proceed, unless paused or out of tokens; park it then */
+void
+again(struct conn *c, struct backend *b)
+{
+	if(!paused && qps == 0){
+		proceed(c, b);
+		return;
+	}
+	if(!paused && tokens >= 1){
+		tokens--;
+		proceed(c, b);
+		return;
+	}
+
+	nparked++;
+	if(scen != nil)
+		TAILQ_INSERT_TAIL(&parked, c, plink);
+	else
+		b->parked++;
+}
+
+/*
+	Take a parked loop off, the longest waiting session first;
+	with over, only one that is too many. Returns its backend, or
+	nil if there's none; *cp is its conn.
+*/
+struct backend *
+unpark(struct conn **cp, int over)
+{
+	static int rotor;
+	struct backend *b;
+	struct conn *c;
+	int i;
+
+	*cp = nil;
+	if(scen != nil){
+		TAILQ_FOREACH(c, &parked, plink){
+			if(!over || toomany(c->b))
+				break;
+		}
+		if(c == nil)
+			return nil;
+		TAILQ_REMOVE(&parked, c, plink);
+		nparked--;
+		*cp = c;
+		return c->b;
+	}
+
+	for(i=0; i<nbackends; i++){
+		b = &backends[rotor++ % nbackends];
+		if(b->parked > 0 && (!over || toomany(b))){
+			b->parked--;
+			nparked--;
+			return b;
+		}
+	}
+	return nil;
+}
+
+/* let parked loops go, as far as the pause and the rate allow */
+void
+release()
+{
+	struct conn *c;
+	struct backend *b;
+
+	while(nparked > 0 && !paused && (qps == 0 || tokens >= 1)){
+		if(qps > 0)
+			tokens--;
+		b = unpark(&c, 0);
+		proceed(c, b);
+	}
+}
+
+void
+ratecb(int fd, short what, void *arg)
+{
+	int64_t now;
+	double max;
+
+	counts.callbacks++;
+	now = nsec();
+	tokens += qps * (now - ratelast) / 1e9;
+	ratelast = now;
+	max = qps * RATE_BURST / 1e9 + 1;
+	if(tokens > max)
+		tokens = max;
+	release();
+}
+
+/* the worker's end of the control socket */
+void
+ctlcb(int fd, short what, void *arg)
+{
+	struct ctl m;
+	struct conn *c;
+	struct backend *b;
+
+	counts.callbacks++;
+	if(atomicio(read, fd, &m, sizeof(m)) != sizeof(m)){
+		event_del(&ctlev);
+		return;
+	}
+
+	switch(m.op){
+	case Cconcurrency:
+		/* once -n is reached, we're done */
+		if(params.count >= 0 && counts.done >= params.count)
+			break;
+		want = m.v;
+		/* fewer: the parked end now, the rest as they finish */
+		while(nparked > 0 && (b = unpark(&c, 1)) != nil)
+			retire(c, b);
+		while(params.concurrency < want){
+			params.concurrency++;
+			if(params.ab){
+				b = &backends[backends[1].loops < backends[0].loops];
+				b->loops++;
+			}else
+				b = pick();
+			again(scen != nil ? mkconn(b) : nil, b);
+		}
+		break;
+	case Crate:
+		qps = m.v;
+		tokens = 1;
+		ratelast = nsec();
+		if(qps > 0)
+			evtimer_add(&rateev, &pacetv);
+		else
+			evtimer_del(&rateev);
+		release();
+		break;
+	case Cinterval:
+		reporttv.tv_sec = m.v;
+		reporttv.tv_usec = (m.v - reporttv.tv_sec) * 1e6 + 0.5;
+		evtimer_del(&reportev);
+		evtimer_add(&reportev, &reporttv);
+		break;
+	case Cpause:
+		paused = 1;
+		break;
+	case Cresume:
+		paused = 0;
+		release();
+		break;
+	}
+}
+
+void
+startctl()
+{
+	want = params.concurrency;
+	event_set(&rateev, -1, EV_PERSIST, ratecb, nil);
+	event_set(&ctlev, STDOUT_FILENO, EV_READ|EV_PERSIST, ctlcb, nil);
+	event_add(&ctlev, nil);
+}
+
+void
+complete(int how, struct conn *c)
+{
+	int i;
+	struct backend *b = c->b;
+	int64_t ns;
+
+	evtimer_del(&c->timeoutev);
+	b->outstanding--;
+
+	ns = nsec() - c->start;
+	switch(how){
+	case Success:
+		success(b, ns);
+		if(c->txts > 0 && c->rxts > c->txts)
+			histadd(&counts.klat, c->rxts - c->txts);
+		break;
+	case Error:
+		counts.errors++;
+		b->st.errors++;
+		break;
+	case Timeout:
+		counts.timeouts++;
+		b->st.timeouts++;
+		break;
+	}
+	counts.done++;
+	if(scen != nil)
+		stepdone(c, how, ns);
+	if(params.nsizes > 0)
+		sizedone(c, how, ns);
+	if(params.slow > 0 && (nslows < params.slow || ns > slows[0].ns))
+		slowadd(c, how, ns);
+
+	if(c->h != nil)
+		h2end(c);
+	else if(how != Success || !c->r.keepalive ||
+	    (params.rpc>0 && c->reqno>=params.rpc)){
+		if(scen != nil)
+			hangup(c);
+		else
+			freeconn(c);
+	}else if(scen == nil){
+		c->state = Idle;
+		LIST_INSERT_HEAD(&b->idle, c, link);
+	}
+
+	/* enqueue the next one; -B keeps each target's share */
+	if(params.count<0 || counts.done<params.count){
+		if(toomany(b))
+			retire(scen != nil ? c : nil, b);
+		else
+			again(c, b);
+	}else{
+		if(scen != nil)
+			freeconn(c);
+		/* the parked would wait for ever */
+		while(nparked > 0){
+			b = unpark(&c, 0);
+			retire(c, b);
+		}
+		if(--params.concurrency == 0){
+			for(i=0; i<nbackends; i++){
+				while((c = LIST_FIRST(&backends[i].idle)) != nil){
+					LIST_REMOVE(c, link);
+					freeconn(c);
+				}
+				while(LIST_FIRST(&backends[i].h2s) != nil)
+					h2close(LIST_FIRST(&backends[i].h2s));
+			}
+			evtimer_del(&reportev);
+			evtimer_del(&lagev);
+			evtimer_del(&rateev);
+			event_del(&ctlev);
+			reportcb(0, 0, nil);  /* issue a last report */
+		}
+	}
+}
+
+/*
+	TLS. We don't verify the server: we're here to load it, not
+	to trust it. Each backend keeps a stack of the sessions it was
+	given, and params.resume of the handshakes offer one, so the
+	mix of full and abbreviated handshakes is ours to pick.
+
+	TLS 1.3 tickets are single use (OpenSSL won't offer one twice),
+	so an offered session is off the stack for good; the server
+	sends fresh ones. Older sessions go back once they've resumed.
+*/
+
+void
+pushsession(struct backend *b, SSL_SESSION *sess)
+{
+	if(b->nsessions == MAX_SESSIONS){
+		SSL_SESSION_free(b->sessions[0]);
+		memmove(b->sessions, b->sessions+1, (MAX_SESSIONS-1) * sizeof(b->sessions[0]));
+		b->nsessions--;
+	}
+	b->sessions[b->nsessions++] = sess;
+}
+
+int
+newsession(SSL *ssl, SSL_SESSION *sess)
+{
+	struct conn *c = SSL_get_app_data(ssl);
+
+	pushsession(c->b, sess);
+	return 1;	/* we keep the reference */
+}
+
+void
+tlsinit()
+{
+	if((tlsctx = SSL_CTX_new(TLS_client_method())) == nil)
+		panic("SSL_CTX_new");
+
+	SSL_CTX_set_verify(tlsctx, SSL_VERIFY_NONE, nil);
+	SSL_CTX_set_mode(tlsctx, SSL_MODE_ENABLE_PARTIAL_WRITE|
+	    SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER|SSL_MODE_RELEASE_BUFFERS);
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+	SSL_CTX_set_options(tlsctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+	SSL_CTX_set_session_cache_mode(tlsctx,
+	    SSL_SESS_CACHE_CLIENT|SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_sess_set_new_cb(tlsctx, newsession);
+}
+
+/* Step the handshake on c; the request goes out once it's done. */
+void
+handshake(struct conn *c)
+{
+	int n;
+
+	if((n = SSL_do_handshake(c->ssl)) == 1){
+		c->hsdone = nsec();
+		histadd(&counts.hs, c->hsdone - c->hsstart);
+		counts.handshakes++;
+		if(SSL_session_reused(c->ssl)){
+			counts.resumed++;
+			if(SSL_version(c->ssl) < TLS1_3_VERSION)
+				pushsession(c->b, SSL_get1_session(c->ssl));
+		}
+		event_add(&c->wev, nil);
+		return;
+	}
+
+	switch(SSL_get_error(c->ssl, n)){
+	case SSL_ERROR_WANT_READ:
+		event_del(&c->wev);
+		break;
+	case SSL_ERROR_WANT_WRITE:
+		event_add(&c->wev, nil);
+		break;
+	default:
+		complete(Error, c);
+	}
+}
+
+/* Start TLS on c, once it's connected; writecb drives the handshake. */
+int
+tlsstart(struct conn *c)
+{
+	struct backend *b = c->b;
+	SSL_SESSION *sess;
+
+	if((c->ssl = SSL_new(tlsctx)) == nil)
+		return -1;
+
+	SSL_set_fd(c->ssl, c->fd);
+	SSL_set_app_data(c->ssl, c);
+	SSL_set_connect_state(c->ssl);
+	if(b->sni[0] != '\0')
+		SSL_set_tlsext_host_name(c->ssl, b->sni);
+
+	/* resume in proportion, exactly */
+	resumeacc += params.resume;
+	if(resumeacc >= 1){
+		resumeacc -= 1;
+		if(b->nsessions > 0){
+			sess = b->sessions[--b->nsessions];
+			SSL_set_session(c->ssl, sess);
+			SSL_SESSION_free(sess);
+		}
+	}
+
+	c->hsstart = nsec();
+	return 0;
+}
+
+/*
+	Kernel timestamps (-J). The send timestamp of our request comes
+	back on the socket's error queue, and that of the response's
+	arrival with its first read. Both are taken where the stack
+	meets the device, so their difference leaves out our own time.
+*/
+
+#ifdef __linux__
+int64_t
+cmsgts(struct msghdr *m)
+{
+	struct cmsghdr *cm;
+	struct scm_timestamping *ts;
+
+	for(cm = CMSG_FIRSTHDR(m); cm != nil; cm = CMSG_NXTHDR(m, cm)){
+		if(cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPING){
+			ts = (struct scm_timestamping *)CMSG_DATA(cm);
+			return (int64_t)ts->ts[0].tv_sec*1000000000 + ts->ts[0].tv_nsec;
+		}
+	}
+	return 0;
+}
+
+int
+tsread(struct conn *c)
+{
+	struct evbuffer_iovec v;
+	struct iovec iov;
+	struct msghdr m;
+	char ctl[512];
+	int64_t t;
+	int n;
+
+	/* one request at a time: the last send is its last byte */
+	for(;;){
+		memset(&m, 0, sizeof(m));
+		m.msg_control = ctl;
+		m.msg_controllen = sizeof(ctl);
+		if(recvmsg(c->fd, &m, MSG_ERRQUEUE) < 0)
+			break;
+		if((t = cmsgts(&m)) > 0)
+			c->txts = t;
+	}
+
+	if(evbuffer_reserve_space(c->in, 16384, &v, 1) < 1)
+		return -1;
+	iov.iov_base = v.iov_base;
+	iov.iov_len = v.iov_len;
+	memset(&m, 0, sizeof(m));
+	m.msg_iov = &iov;
+	m.msg_iovlen = 1;
+	m.msg_control = ctl;
+	m.msg_controllen = sizeof(ctl);
+	if((n = recvmsg(c->fd, &m, 0)) <= 0)
+		return n;
+	v.iov_len = n;
+	evbuffer_commit_space(c->in, &v, 1);
+
+	if(c->rxts == 0 && (t = cmsgts(&m)) > 0)
+		c->rxts = t;
+	return n;
+}
+#else
+int
+tsread(struct conn *c)
+{
+	return evbuffer_read(c->in, c->fd, -1);
+}
+#endif
+
+/*
+	Like evbuffer_read(c->in, c->fd, -1), but through TLS, or for
+	kernel timestamps, if need be.
+*/
+/* SSL_read's failure n, as read(2) would have it */
+int
+sslreaderr(struct conn *c, int n)
+{
+	switch(SSL_get_error(c->ssl, n)){
+	case SSL_ERROR_WANT_READ:
+	case SSL_ERROR_WANT_WRITE:
+		errno = EAGAIN;
+		return -1;
+	case SSL_ERROR_ZERO_RETURN:
+		return 0;
+	case SSL_ERROR_SYSCALL:
+		if(n == 0)
+			return 0;
+		return -1;
+	default:
+		errno = EIO;
+		return -1;
+	}
+}
+
+int
+connread(struct conn *c)
+{
+	struct evbuffer_iovec v;
+	int n, tot;
+
+	if(c->ssl == nil && params.kts)
+		return tsread(c);
+	if(c->ssl == nil)
+		return evbuffer_read(c->in, c->fd, -1);
+
+	for(tot=0;; tot+=n){
+		if(evbuffer_reserve_space(c->in, 16384, &v, 1) < 1)
+			return -1;
+		n = SSL_read(c->ssl, v.iov_base, v.iov_len);
+		if(n <= 0)
+			break;
+		v.iov_len = n;
+		evbuffer_commit_space(c->in, &v, 1);
+	}
+
+	if(tot > 0)
+		return tot;
+	return sslreaderr(c, n);
+}
+
+/*
+	-S: while all that's left of a response is its body, read it
+	into streambuf, around c->in, and drop it there. There are no
+	evbuffer chains to allocate and free, and a read takes up to
+	STREAM_BUF, not the few KB that evbuffer_read does. We never
+	read past the body, so whatever follows stays for c->in.
+*/
+int
+streamread(struct conn *c)
+{
+	size_t len;
+	int n;
+
+	if((c->r.state != Pbody && c->r.state != Pchunk) ||
+	    evbuffer_get_length(c->in) > 0)
+		return connread(c);
+
+	len = c->r.left < STREAM_BUF ? c->r.left : STREAM_BUF;
+	if(c->ssl == nil)
+		n = read(c->fd, streambuf, len);
+	else if((n = SSL_read(c->ssl, streambuf, len)) <= 0)
+		return sslreaderr(c, n);
+
+	if(n > 0)
+		respbody(&c->r, (uint8_t *)streambuf, n);
+	return n;
+}
+
+/* Like evbuffer_write(c->out, c->fd), but through TLS if need be. */
+int
+connwrite(struct conn *c)
+{
+	size_t len;
+	int n;
+
+	if(c->ssl == nil){
+		if((n = evbuffer_write(c->out, c->fd)) > 0)
+			counts.txbytes += n;
+		return n;
+	}
+
+	while((len = evbuffer_get_length(c->out)) > 0){
+		if(len > 16384)
+			len = 16384;
+		if((n = SSL_write(c->ssl, evbuffer_pullup(c->out, len), len)) <= 0){
+			switch(SSL_get_error(c->ssl, n)){
+			case SSL_ERROR_WANT_READ:
+			case SSL_ERROR_WANT_WRITE:
+				errno = EAGAIN;
+				break;
+			default:
+				errno = EIO;
+			}
+			return -1;
+		}
+		evbuffer_drain(c->out, n);
+		counts.txbytes += n;
+	}
+
+	return 0;
+}
+
+/*
+	HTTP/2, in the clear with prior knowledge. Requests to a target
+	are all the same but for a templated path, so we send our
+	:authority with incremental indexing once per connection and
+	refer to it by index after that: the header block of every
+	later request is four bytes, plus the path's. We don't decode
+	the server's headers; they matter only for their end.
+*/
+
+void h2readcb(int fd, short what, void *arg);
+void h2writecb(int fd, short what, void *arg);
+
+/* A connection to b that takes another stream, dialing if need be. */
+struct h2 *
+h2get(struct backend *b)
+{
+	struct h2 *h;
+	uint8_t set[3*6], *p;
+	int i;
+
+	LIST_FOREACH(h, &b->h2s, link){
+		if(!h->draining && h->nstreams < params.streams &&
+		    h->nstreams < h->maxstreams)
+			return h;
+	}
+
+	if((h = calloc(1, sizeof(*h))) == nil)
+		panic("calloc");
+	if((h->fd = dialfd(b)) < 0){
+		free(h);
+		return nil;
+	}
+	if((h->in = evbuffer_new()) == nil || (h->out = evbuffer_new()) == nil)
+		panic("evbuffer_new");
+
+	h->b = b;
+	h->connecting = 1;
+	h->nextid = 1;
+	h->maxstreams = UINT32_MAX;
+	h->tablesize = 4096;
+	for(i=0; i<NSTREAMHASH; i++)
+		LIST_INIT(&h->streams[i]);
+	LIST_INSERT_HEAD(&b->h2s, h, link);
+
+	evbuffer_add(h->out, H2PREFACE, H2npreface);
+	p = h2setting(set, Spush, 0);
+	p = h2setting(p, Swindow, params.window);
+	h2put(h->out, Tsettings, 0, 0, set, p - set);
+	if(params.window > H2window)
+		h2window(h->out, 0, params.window - H2window);
+
+	event_assign(&h->rev, evbase, h->fd, EV_READ|EV_PERSIST, h2readcb, h);
+	event_assign(&h->wev, evbase, h->fd, EV_WRITE|EV_PERSIST, h2writecb, h);
+	event_add(&h->rev, nil);
+	event_add(&h->wev, nil);
+
+	return h;
+}
+
+/* Close h, failing whatever streams are left on it. */
+void
+h2close(struct h2 *h)
+{
+	struct conn *c;
+	int i;
+
+	if(!h->dead){
+		h->dead = 1;
+		LIST_REMOVE(h, link);
+		counts.closes++;
+	}
+	if(h->busy)
+		return;		/* h2readcb finishes the job */
+
+	for(i=0; i<NSTREAMHASH; i++){
+		while((c = LIST_FIRST(&h->streams[i])) != nil)
+			complete(Error, c);
+	}
+
+	event_del(&h->rev);
+	event_del(&h->wev);
+	close(h->fd);
+	evbuffer_free(h->in);
+	evbuffer_free(h->out);
+	free(h);
+}
+
+struct conn *
+h2stream(struct h2 *h, uint32_t sid)
+{
+	struct conn *c;
+
+	LIST_FOREACH(c, &h->streams[(sid>>1) % NSTREAMHASH], link){
+		if(c->sid == sid)
+			return c;
+	}
+	return nil;
+}
+
+/* Issue c's request on a new stream. */
+void
+h2dispatch(struct conn *c)
+{
+	struct backend *b = c->b;
+	struct h2 *h;
+	uint8_t blk[H2maxframe];
+	char path[H2maxframe];
+	size_t n, len;
+
+	b->outstanding++;
+
+	if((h = h2get(b)) == nil){
+		/* as in dispatch */
+		c->state = Failed;
+		c->start = nsec();
+		evtimer_add(&c->timeoutev, &retrytv);
+		return;
+	}
+
+	c->h = h;
+	c->sid = h->nextid;
+	c->unacked = 0;
+	c->state = Busy;
+	h->nextid += 2;
+	h->nstreams++;
+	if(++h->reqno == params.rpc || h->nextid >= 1u<<30)
+		h->draining = 1;
+	LIST_INSERT_HEAD(&h->streams[(c->sid>>1) % NSTREAMHASH], c, link);
+
+	c->start = nsec();
+	evtimer_add(&c->timeoutev, &timeouttv);
+
+	/* GET http, and the path: / or a literal, never indexed */
+	n = 0;
+	blk[n++] = 0x82;
+	blk[n++] = 0x86;
+	if(reqpath == nil)
+		blk[n++] = 0x84;
+	else{
+		len = tmplfill(reqpath, path);
+		n += hpackint(blk + n, 4, 0x00, 4);
+		n += hpackint(blk + n, 7, 0, len);
+		memcpy(blk + n, path, len);
+		n += len;
+	}
+
+	if(h->indexed)
+		blk[n++] = 0xbe;	/* dynamic entry 62: our :authority */
+	else{
+		memcpy(blk + n, b->h2req, b->nh2req);
+		if(h->tablesize >= b->h2entry)
+			h->indexed = 1;
+		else
+			blk[n] = 0x01;	/* no room in the server's table */
+		n += b->nh2req;
+	}
+
+	h2put(h->out, Theaders, Fendstream|Fendheaders, c->sid, blk, n);
+	event_add(&h->wev, nil);
+}
+
+/* c is done with; take it off its connection. */
+void
+h2end(struct conn *c)
+{
+	struct h2 *h = c->h;
+
+	LIST_REMOVE(c, link);
+	h->nstreams--;
+	c->h = nil;
+	freeconn(c);
+
+	if(h->draining && h->nstreams == 0 && !h->dead)
+		h2close(h);
+}
+
+/* Tell the server we've given up on c. */
+void
+h2cancel(struct conn *c)
+{
+	h2rst(c->h->out, c->sid, Ecancel);
+	event_add(&c->h->wev, nil);
+}
+
+/*
+	Give back receive window once half of it is used, for the
+	connection (sid 0) or a stream.
+*/
+void
+h2credit(struct h2 *h, uint32_t sid, int64_t *unacked, uint32_t n)
+{
+	*unacked += n;
+	if(*unacked >= params.window/2){
+		h2window(h->out, sid, *unacked);
+		*unacked = 0;
+	}
+}
+
+/* Act on frame f, which is at the head of h->in. */
+int
+h2act(struct h2 *h, struct h2frame *f)
+{
+	struct conn *c, *next;
+	uint8_t *p;
+	uint32_t last, v;
+	int i, id;
+
+	c = f->sid != 0 ? h2stream(h, f->sid) : nil;
+	p = nil;
+	if(f->type == Tsettings || f->type == Tping || f->type == Tgoaway)
+		p = evbuffer_pullup(h->in, H2hdr + f->len) + H2hdr;
+
+	switch(f->type){
+	case Tdata:
+		/* padding and all; cancelled streams' data too */
+		h2credit(h, 0, &h->unacked, f->len);
+		if(c == nil)
+			break;
+		if(f->flags & Fendstream)
+			complete(Success, c);
+		else
+			h2credit(h, c->sid, &c->unacked, f->len);
+		break;
+
+	case Theaders:
+		if(c != nil && (f->flags & Fendstream))
+			complete(Success, c);
+		break;
+
+	case Trst:
+		if(c != nil)
+			complete(Error, c);
+		break;
+
+	case Tsettings:
+		if(f->flags & Fack)
+			break;
+		if(f->len % 6 != 0)
+			return -1;
+		for(i=0; i<f->len; i+=6){
+			id = p[i]<<8 | p[i+1];
+			v = h2get32(p + i + 2);
+			if(id == Smaxstreams)
+				h->maxstreams = v;
+			else if(id == Stablesize)
+				h->tablesize = v;
+		}
+		h2put(h->out, Tsettings, Fack, 0, nil, 0);
+		break;
+
+	case Tping:
+		if(!(f->flags & Fack) && f->len == 8)
+			h2put(h->out, Tping, Fack, 0, p, 8);
+		break;
+
+	case Tgoaway:
+		if(f->len < 8)
+			return -1;
+		/* streams after last weren't seen, and never will be */
+		last = h2get32(p) & 0x7fffffff;
+		h->draining = 1;
+		for(i=0; i<NSTREAMHASH; i++){
+			for(c = LIST_FIRST(&h->streams[i]); c != nil; c = next){
+				next = LIST_NEXT(c, link);
+				if(c->sid > last)
+					complete(Error, c);
+			}
+		}
+		if(h->nstreams == 0)
+			return -1;
+		break;
+	}
+
+	return 0;
+}
+
+void
+h2readcb(int fd, short what, void *arg)
+{
+	struct h2 *h = arg;
+	struct h2frame f;
+	int n;
+
+	counts.callbacks++;
+
+	n = evbuffer_read(h->in, fd, -1);
+	if(n < 0 && (errno == EAGAIN || errno == EINTR))
+		return;
+	if(n > 0)
+		counts.rxbytes += n;
+
+	h->busy = 1;
+	if(n <= 0)
+		h2close(h);
+
+	while(!h->dead && (n = h2next(h->in, &f)) != 0){
+		if(n < 0 || h2act(h, &f) < 0){
+			h2close(h);
+			break;
+		}
+		evbuffer_drain(h->in, H2hdr + f.len);
+	}
+	h->busy = 0;
+
+	if(h->dead)
+		h2close(h);
+	else if(evbuffer_get_length(h->out) > 0)
+		event_add(&h->wev, nil);
+}
+
+void
+h2writecb(int fd, short what, void *arg)
+{
+	struct h2 *h = arg;
+	int err, n;
+	socklen_t len = sizeof(err);
+
+	counts.callbacks++;
+
+	if(h->connecting){
+		if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0){
+			h2close(h);
+			return;
+		}
+		h->connecting = 0;
+	}
+
+	if((n = evbuffer_write(h->out, fd)) > 0)
+		counts.txbytes += n;
+	else if(n < 0 && errno != EAGAIN && errno != EINTR){
+		h2close(h);
+		return;
+	}
+
+	if(evbuffer_get_length(h->out) == 0)
+		event_del(&h->wev);
+}
+
+/*
+	Connection setup (-R). Connects are issued open loop, in a batch
+	every PACE_PERIOD, to keep up with the rate whatever the target
+	does. A connect is timed to the SYN-ACK; then we send our FIN
+	and wait for the server's, which it sends only once its accept
+	loop has got to the connection. So a full SYN queue shows as
+	SYN timeouts and slow connects (the SYN is sent again after a
+	second), and a slow accept loop as unserved connections.
+*/
+
+/* err is the errno, for an Error */
+void
+connend(struct conn *c, int how, int err)
+{
+	evtimer_del(&c->timeoutev);
+	c->b->outstanding--;
+	inflight--;
+
+	switch(how){
+	case Success:
+		success(c->b, c->connns);
+		break;
+	case Timeout:
+		if(c->connecting)
+			counts.timeouts++;
+		else
+			counts.unserved++;
+		c->b->st.timeouts++;
+		break;
+	default:
+		/* a full Unix socket backlog says EAGAIN */
+		if(err == ECONNREFUSED || err == EAGAIN)
+			counts.refused++;
+		else if(err == ECONNRESET)
+			counts.resets++;
+		counts.errors++;
+		c->b->st.errors++;
+		break;
+	}
+	counts.done++;
+	freeconn(c);
+
+	if(params.count >= 0 && counts.done >= params.count && inflight == 0){
+		evtimer_del(&paceev);
+		evtimer_del(&reportev);
+		evtimer_del(&lagev);
+		reportcb(0, 0, nil);  /* issue a last report */
+	}
+}
+
+void
+connreadcb(int fd, short what, void *arg)
+{
+	struct conn *c = arg;
+	char buf[512];
+	int n;
+
+	counts.callbacks++;
+
+	/* whatever the server says, we only wait for its close */
+	while((n = read(fd, buf, sizeof(buf))) > 0)
+		;
+	if(n == 0)
+		connend(c, Success, 0);
+	else if(errno != EAGAIN && errno != EINTR)
+		connend(c, Error, errno);
+}
+
+void
+connwritecb(int fd, short what, void *arg)
+{
+	struct conn *c = arg;
+	int err;
+	socklen_t len = sizeof(err);
+
+	counts.callbacks++;
+
+	if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+		err = errno;
+	if(err != 0){
+		connend(c, Error, err);
+		return;
+	}
+
+	c->connns = nsec() - c->start;
+	c->connecting = 0;
+	event_del(&c->wev);
+	shutdown(fd, SHUT_WR);
+	event_add(&c->rev, nil);
+}
+
+void
+connissue()
+{
+	struct conn *c;
+	int fd;
+
+	c = mkconn(pick());
+	c->b->outstanding++;
+	inflight++;
+	c->start = nsec();
+	c->connecting = 1;
+
+	if((fd = dialfd(c->b)) < 0){
+		connend(c, Error, errno);
+		return;
+	}
+
+	c->fd = fd;
+	event_assign(&c->rev, evbase, fd, EV_READ|EV_PERSIST, connreadcb, c);
+	event_assign(&c->wev, evbase, fd, EV_WRITE|EV_PERSIST, connwritecb, c);
+	event_add(&c->wev, nil);
+	evtimer_add(&c->timeoutev, &timeouttv);
+}
+
+void
+pacecb(int fd, short what, void *arg)
+{
+	static int warned;
+	int64_t due;
+
+	counts.callbacks++;
+
+	due = (nsec() - pacestart) / 1000 * params.crate / 1000000;
+	if(params.count >= 0 && due > params.count)
+		due = params.count;
+
+	/* -c bounds the connections in flight, and so our fds */
+	for(; npaced < due && inflight < params.concurrency; npaced++)
+		connissue();
+
+	if(npaced < due && !warned++)
+		fprintf(stderr, "# warning: %d connections in flight; "
+		    "raise -c to keep up the rate\n", inflight);
+	if(npaced == params.count)
+		evtimer_del(&paceev);
+}
+
+void
+startpace()
+{
+	pacestart = nsec();
+	event_set(&paceev, -1, EV_PERSIST, pacecb, nil);
+	evtimer_add(&paceev, &pacetv);
+}
+
+/*
+	Holding connections (-I). The pace timer opens connections,
+	HOLD_RAMP per PACE_PERIOD, until -I are open, and opens
+	them again as they close. It sends requests at the rate, each
+	on a connection picked at random, if that one is idle; and it
+	times out the connects and requests in progress, of which
+	there are few. A held connection that the server closes is
+	counted as a close; those we close ourselves are not.
+*/
+
+void holdcb(int fd, short what, void *arg);
+
+void
+busyadd(struct hold *h)
+{
+	h->busy = nholdbusy;
+	holdbusy[nholdbusy++] = h - holds;
+}
+
+void
+busydel(struct hold *h)
+{
+	int last = holdbusy[--nholdbusy];
+
+	holdbusy[h->busy] = last;
+	holds[last].busy = h->busy;
+	h->busy = -1;
+}
+
+struct backend *
+holdbackend(struct hold *h)
+{
+	return &backends[(h - holds) % nbackends];
+}
+
+void
+holdclose(struct hold *h)
+{
+	event_del(&h->ev);
+	close(event_get_fd(&h->ev));
+	if(h->state != Hconnecting)
+		nheld--;
+	if(h->busy >= 0)
+		busydel(h);
+	if(h->q != nil){
+		evbuffer_drain(h->q->in, evbuffer_get_length(h->q->in));
+		h->q->next = holdreqs;
+		holdreqs = h->q;
+		h->q = nil;
+	}
+	h->state = Hclosed;
+	holdfree[nholdfree++] = h - holds;
+}
+
+int
+holdopen(struct hold *h)
+{
+	int fd;
+
+	if((fd = dialfd(holdbackend(h))) < 0)
+		return -1;
+
+	h->state = Hconnecting;
+	h->start = nsec();
+	busyadd(h);
+	event_assign(&h->ev, evbase, fd, EV_WRITE, holdcb, h);
+	event_add(&h->ev, nil);
+	return 0;
+}
+
+/* A request is over: count it, and stop at -n. */
+void
+holddone()
+{
+	int i;
+
+	counts.done++;
+	if(params.count < 0 || counts.done < params.count)
+		return;
+
+	holdover = 1;
+	for(i=0; i<params.hold; i++){
+		if(holds[i].state != Hclosed)
+			holdclose(&holds[i]);
+	}
+	evtimer_del(&paceev);
+	evtimer_del(&reportev);
+	evtimer_del(&lagev);
+	reportcb(0, 0, nil);  /* issue a last report */
+}
+
+/* A request on h, if it's idle. It's small: one write will do. */
+void
+holdsend(struct hold *h)
+{
+	struct backend *b = holdbackend(h);
+	struct holdreq *q;
+	static char *buf;
+	static size_t nbuf;
+	char *p;
+	size_t n;
+
+	if(h->state != Hidle)
+		return;
+
+	p = b->req;
+	n = b->nreq;
+	if(reqpath != nil){
+		if(4 + reqpath->max + b->nreq > nbuf){
+			nbuf = 4 + reqpath->max + b->nreq;
+			buf = remal(buf, nbuf);
+		}
+		memcpy(buf, "GET ", 4);
+		n = 4 + tmplfill(reqpath, buf + 4);
+		memcpy(buf + n, b->req + 5, b->nreq - 5);
+		n += b->nreq - 5;
+		p = buf;
+	}
+
+	if(write(event_get_fd(&h->ev), p, n) != n){
+		counts.errors++;
+		b->st.errors++;
+		holdclose(h);
+		holddone();
+		return;
+	}
+
+	counts.txbytes += n;
+	if((q = holdreqs) != nil)
+		holdreqs = q->next;
+	else{
+		q = mal(sizeof(*q));
+		if((q->in = evbuffer_new()) == nil)
+			panic("evbuffer_new");
+	}
+	respinit(&q->r);
+	h->q = q;
+	h->state = Hbusy;
+	h->start = nsec();
+	busyadd(h);
+}
+
+void
+holdcb(int fd, short what, void *arg)
+{
+	struct hold *h = arg;
+	struct backend *b = holdbackend(h);
+	char buf[512];
+	int n, err, keep;
+	socklen_t len = sizeof(err);
+
+	counts.callbacks++;
+
+	switch(h->state){
+	case Hconnecting:
+		if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0){
+			counts.errors++;
+			holdclose(h);
+			return;
+		}
+		busydel(h);
+		h->state = Hidle;
+		nheld++;
+		event_assign(&h->ev, evbase, fd, EV_READ|EV_PERSIST, holdcb, h);
+		event_add(&h->ev, nil);
+		return;
+
+	case Hidle:
+		/* nothing is due: the server is hanging up */
+		while((n = read(fd, buf, sizeof(buf))) > 0)
+			;
+		if(n == 0 || (errno != EAGAIN && errno != EINTR)){
+			counts.closes++;
+			holdclose(h);
+		}
+		return;
+
+	case Hbusy:
+		n = evbuffer_read(h->q->in, fd, -1);
+		if(n < 0 && (errno == EAGAIN || errno == EINTR))
+			return;
+		if(n > 0)
+			counts.rxbytes += n;
+
+		switch(n > 0 ? respparse(&h->q->r, h->q->in) : -1){
+		case 0:
+			return;
+		case 1:
+			success(b, nsec() - h->start);
+			keep = h->q->r.keepalive;
+			evbuffer_drain(h->q->in, evbuffer_get_length(h->q->in));
+			h->q->next = holdreqs;
+			holdreqs = h->q;
+			h->q = nil;
+			busydel(h);
+			h->state = Hidle;
+			if(!keep)
+				holdclose(h);
+			break;
+		default:
+			counts.errors++;
+			b->st.errors++;
+			if(n == 0)
+				counts.closes++;
+			holdclose(h);
+			break;
+		}
+		holddone();
+		return;
+	}
+}
+
+void
+holdpacecb(int fd, short what, void *arg)
+{
+	struct hold *h;
+	int64_t now, due, timeout;
+	int i, busy;
+
+	counts.callbacks++;
+	now = nsec();
+
+	/* from the end: a close moves the last one into its place */
+	timeout = timeouttv.tv_sec * 1000000000LL + timeouttv.tv_usec * 1000LL;
+	for(i=nholdbusy-1; i>=0 && !holdover; i--){
+		h = &holds[holdbusy[i]];
+		if(now - h->start < timeout)
+			continue;
+		counts.timeouts++;
+		busy = h->state == Hbusy;
+		if(busy)
+			holdbackend(h)->st.timeouts++;
+		holdclose(h);
+		if(busy)
+			holddone();
+	}
+
+	for(i=0; i<HOLD_RAMP && nholdfree>0 && !holdover; i++){
+		if(holdopen(&holds[holdfree[nholdfree - 1]]) < 0){
+			/* out of fds or ports, most likely; try again later */
+			counts.errors++;
+			break;
+		}
+		nholdfree--;
+	}
+
+	due = (now - pacestart) / 1000 * params.holdrate / 1000000;
+	for(; npaced < due && !holdover; npaced++)
+		holdsend(&holds[random() % params.hold]);
+}
+
+void
+starthold()
+{
+	struct rlimit rl;
+	int i;
+
+	/* a descriptor for each */
+	if(getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max){
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+	if(rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur < params.hold + 64)
+		fprintf(stderr, "# warning: %d descriptors per worker; "
+		    "too few to hold %d connections\n", (int)rl.rlim_cur, params.hold);
+
+	if((holds = calloc(params.hold, sizeof(*holds))) == nil)
+		panic("calloc");
+	holdfree = mal(params.hold * sizeof(holdfree[0]));
+	holdbusy = mal(params.hold * sizeof(holdbusy[0]));
+	for(i=params.hold-1; i>=0; i--){
+		holds[i].busy = -1;
+		holdfree[nholdfree++] = i;
+	}
+
+	pacestart = nsec();
+	event_set(&paceev, -1, EV_PERSIST, holdpacecb, nil);
+	evtimer_add(&paceev, &pacetv);
+}
+
+/* -X: is c's body the same as the first from its target? */
+int
+sumcheck(struct conn *c)
+{
+	struct backend *b = c->b;
+
+	if(!b->summed){
+		b->suma = c->r.suma;
+		b->sumb = c->r.sumb;
+		b->summed = 1;
+	}
+	if(c->r.suma == b->suma && c->r.sumb == b->sumb)
+		return 1;
+	counts.mismatched++;
+	return 0;
+}
+
+/*
+	Is c's response, whole, a success? -X's checksum has a say,
+	and in a scenario, so does the status, and the step's values
+	must be there to take.
+*/
+int
+respok(struct conn *c)
+{
+	if(params.checksum && !sumcheck(c))
+		return 0;
+	if(scen == nil)
+		return 1;
+	return c->r.code < 400 && scentake(&scen->steps[c->step], &c->r, c->vals);
+}
+
+void
+readcb(int fd, short what, void *arg)
+{
+	struct conn *c = arg;
+	int n;
+
+	counts.callbacks++;
+
+	if(c->ssl != nil && !SSL_is_init_finished(c->ssl)){
+		handshake(c);
+		return;
+	}
+
+	n = params.stream ? streamread(c) : connread(c);
+	if(n < 0 && (errno == EAGAIN || errno == EINTR))
+		return;
+	if(n > 0){
+		counts.rxbytes += n;
+		c->rx += n;
+		if(params.slow > 0 && c->firstbyte == 0)
+			c->firstbyte = nsec();
+	}
+
+	if(c->state == Idle){
+		/* the server hung up on a keep-alive connection */
+		LIST_REMOVE(c, link);
+		freeconn(c);
+		return;
+	}
+
+	switch(n > 0 ? respparse(&c->r, c->in) : -1){
+	case 0:
+		return;
+	case 1:
+		complete(respok(c) ? Success : Error, c);
+		return;
+	}
+
+	/* closed or failed: a close-delimited body is now complete */
+	if(n == 0 && c->r.state == Peof)
+		complete(respok(c) ? Success : Error, c);
+	else
+		complete(Error, c);
+}
+
+void
+writecb(int fd, short what, void *arg)
+{
+	struct conn *c = arg;
+	int err;
+	socklen_t len = sizeof(err);
+
+	counts.callbacks++;
+
+	if(c->connecting){
+		if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0){
+			complete(Error, c);
+			return;
+		}
+		c->connecting = 0;
+		if(params.slow > 0)
+			c->connected = nsec();
+		if(params.tls && tlsstart(c) < 0){
+			complete(Error, c);
+			return;
+		}
+	}
+
+	if(c->ssl != nil && !SSL_is_init_finished(c->ssl)){
+		handshake(c);
+		return;
+	}
+
+	if(connwrite(c) < 0 && errno != EAGAIN && errno != EINTR){
+		complete(Error, c);
+		return;
+	}
+
+	if(evbuffer_get_length(c->out) == 0){
+		event_del(&c->wev);
+		if(params.slow > 0 && c->sent == 0)
+			c->sent = nsec();
+	}
+}
+
+void
+timeoutcb(int fd, short what, void *arg)
+{
+	struct conn *c = arg;
+
+	counts.callbacks++;
+
+	if(params.crate > 0){
+		connend(c, Timeout, 0);
+		return;
+	}
+
+	if(c->state == Failed){
+		complete(Error, c);
+		return;
+	}
+
+	/* re-establish the connection, or just give up the stream */
+	if(c->h != nil)
+		h2cancel(c);
+	else
+		hangup(c);
+	complete(Timeout, c);
+}
+
+
+/*
+	Aggregation.
+*/
+
+/*
+	Per-interval statistics. Each interval is a sample of the
+	throughput and of the latency percentiles; their spread gives
+	the confidence intervals of the run's (batch means, with the
+	intervals for batches), shows when it settles, and compares
+	targets.
+*/
+
+enum{
+	Shz,
+	Sp50,
+	Sp90,
+	Sp99,
+	Sp999,
+	Nstat,
+};
+
+char	*statnames[Nstat] = { "hz", "p50", "p90", "p99", "p99.9" };
+double	statq[Nstat] = { 0, 0.5, 0.9, 0.99, 0.999 };
+
+struct series{
+	double (*v)[Nstat];
+	int n;
+};
+
+struct series	ivseries;	/* every interval since the warm-up */
+struct series	abseries[2];	/* -B: A's and B's, paired */
+
+void
+seriesadd(struct series *s, int successes, int64_t ns, struct hist *lat)
+{
+	int k;
+
+	if((s->n & (s->n - 1)) == 0)
+		s->v = remal(s->v, (s->n ? 2*s->n : 1) * sizeof(s->v[0]));
+
+	s->v[s->n][Shz] = ns > 0 ? successes * 1e9 / ns : 0;
+	for(k=Sp50; k<Nstat; k++)
+		s->v[s->n][k] = histquantile(lat, statq[k]) / 1e6;
+	s->n++;
+}
+
+/* Student's t, two-sided 95%, for df degrees of freedom */
+double
+t95(int df)
+{
+	static double t[] = {
+		12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306,
+		2.262, 2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120,
+		2.110, 2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064,
+		2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+	};
+
+	if(df < 1)
+		return INFINITY;
+	if(df <= 30)
+		return t[df - 1];
+	return 1.960 + 2.5 / df;
+}
+
+/*
+	The mean of stat k over samples [from, to) of s, or of their
+	differences from d's if d is set; *sd is their standard
+	deviation.
+*/
+double
+seriesmean(struct series *s, struct series *d, int k, int from, int to, double *sd)
+{
+	double m = 0, v = 0, x;
+	int i, n = to - from;
+
+	for(i=from; i<to; i++)
+		m += s->v[i][k] - (d != nil ? d->v[i][k] : 0);
+	m /= n;
+	for(i=from; i<to; i++){
+		x = s->v[i][k] - (d != nil ? d->v[i][k] : 0) - m;
+		v += x*x;
+	}
+	*sd = n > 1 ? sqrt(v / (n - 1)) : 0;
+	return m;
+}
+
+/* the 95% confidence interval of stat k's mean over the whole run */
+double
+ci95(int k)
+{
+	double sd;
+
+	seriesmean(&ivseries, nil, k, 0, ivseries.n, &sd);
+	return t95(ivseries.n - 1) * sd / sqrt(ivseries.n);
+}
+
+/*
+	Steady state: the last STEADY_WINDOW intervals' throughput
+	and median latency vary by no more than STEADY_CV of their
+	mean.
+*/
+int
+steady()
+{
+	double m, sd;
+	int n = ivseries.n, k;
+
+	if(n < STEADY_WINDOW)
+		return 0;
+	for(k=Shz; k<=Sp50; k++){
+		m = seriesmean(&ivseries, nil, k, n - STEADY_WINDOW, n, &sd);
+		if(m <= 0 || sd / m > STEADY_CV)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+	Drift: a long run that is steady from one interval to the next
+	may still creep. Compare the first half of the run with the
+	second (Welch's t), and say so if they differ.
+*/
+void
+driftreport()
+{
+	double a, b, sa, sb, ci;
+	int n = ivseries.n, h = n / 2, k;
+
+	if(n < 2*STEADY_WINDOW)
+		return;
+	for(k=0; k<Nstat; k++){
+		a = seriesmean(&ivseries, nil, k, 0, h, &sa);
+		b = seriesmean(&ivseries, nil, k, n - h, n, &sb);
+		ci = t95(h - 1) * sqrt((sa*sa + sb*sb) / h);
+		if(fabs(b - a) > ci && a > 0)
+			fprintf(stderr, "# drift\t\t%s %+.1f%% (±%.1f%%) from "
+			    "the first half of the run to the second\n",
+			    statnames[k], 100 * (b - a) / a, 100 * ci / a);
+	}
+}
+
+/*
+	A/B comparison (-B). The two targets get half the concurrency
+	each, and a request that completes is followed by another to
+	the same target, so each runs at its own pace under the same
+	load at the same time. Each interval gives a pair of samples,
+	and we test the mean of their differences: pairing cancels out
+	whatever else the machine was up to.
+*/
+
+void
+absample(struct slot *sl)
+{
+	int i;
+
+	/* no latency to compare without a success on each side */
+	if(sl->b[0].st.successes == 0 || sl->b[1].st.successes == 0)
+		return;
+
+	for(i=0; i<2; i++)
+		seriesadd(&abseries[i], sl->b[i].st.successes, sl->iv.ns, &sl->b[i].lat);
+}
+
+void
+abreport()
+{
+	double a, b, d, sd, ci;
+	int k, n = abseries[0].n;
+	char *fmt;
+
+	fprintf(stderr, "# A\t\t%s\n# B\t\t%s\n", backends[0].name, backends[1].name);
+	if(n < 2){
+		fprintf(stderr, "# ab\t\ttoo few intervals to compare\n");
+		return;
+	}
+
+	fprintf(stderr, "# ab\t\tA\tB\tB-A\t95%% ci\t\t(%d intervals)\n", n);
+	for(k=0; k<Nstat; k++){
+		a = seriesmean(&abseries[0], nil, k, 0, n, &sd);
+		b = seriesmean(&abseries[1], nil, k, 0, n, &sd);
+		d = seriesmean(&abseries[1], &abseries[0], k, 0, n, &sd);
+		ci = t95(n - 1) * sd / sqrt(n);
+
+		fmt = k == Shz ?
+		    "# ab-%s\t%.0f\t%.0f\t%+.0f\t±%.0f (%+.1f%%)\t%s\n" :
+		    "# ab-%s\t%.3f\t%.3f\t%+.3f\t±%.3f (%+.1f%%)\t%s\n";
+		fprintf(stderr, fmt, statnames[k], a, b, d, ci,
+		    a > 0 ? 100 * d / a : 0.0,
+		    fabs(d) > ci ? "significant" : "not significant");
+	}
+}
+
+/*
+	Warm-up (-w). Its intervals are reported as they come, but
+	left out of the summary: when it's over, the totals start
+	afresh. It is over after a time, a number of requests, or
+	once the run is steady; always at an interval's end.
+*/
+
+void
+warmup(struct slot *sl)
+{
+	int64_t ivns;
+	int i;
+
+	warm.intervals++;
+	warm.requests += sl->iv.successes + sl->iv.errors + sl->iv.timeouts;
+
+	ivns = reporttv.tv_sec * 1000000000LL + reporttv.tv_usec * 1000LL;
+	if(params.warmup > 0 && warm.intervals * ivns < params.warmup)
+		return;
+	if(params.warmreqs > 0 && warm.requests < params.warmreqs)
+		return;
+	if(params.warmsteady && !steady())
+		return;
+
+	i = counts.saturated;
+	memset(&counts, 0, sizeof(counts));
+	counts.saturated = i;
+	for(i=0; i<nbackends; i++){
+		memset(&backends[i].st, 0, sizeof(backends[i].st));
+		histclear(&backends[i].lat);
+	}
+	for(i=0; scen != nil && i<scen->nsteps; i++){
+		memset(&steps[i].st, 0, sizeof(steps[i].st));
+		histclear(&steps[i].lat);
+	}
+	for(i=0; i<params.nsizes; i++){
+		memset(&sizes[i].st, 0, sizeof(sizes[i].st));
+		histclear(&sizes[i].lat);
+	}
+	ivseries.n = 0;
+	abseries[0].n = abseries[1].n = 0;
+
+	startns = nsec();
+	warm.over = 1;
+}
+
+int
+slowcmp(const void *a, const void *b)
+{
+	const struct slow *x = a, *y = b;
+
+	return x->ns < y->ns ? 1 : x->ns > y->ns ? -1 : 0;
+}
+
+/* -E: the interval's slowest, slowest first */
+void
+slowreport(struct slot *sl)
+{
+	static char *hows[] = { "ok", "closed", "error", "timeout" };
+	struct slow *s;
+	int i;
+
+	qsort(sl->slow, sl->nslow, sizeof(sl->slow[0]), slowcmp);
+	for(i=0; i<sl->nslow; i++){
+		s = &sl->slow[i];
+		fprintf(stderr, "# slow\t%.3f\t%s\t%d\t%d.%d\t%d\t%lld\t"
+		    "%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%s\n",
+		    s->ns / 1e6, hows[s->how], s->status, s->worker, s->conn,
+		    s->reqno, (long long)s->bytes, s->connect / 1e6, s->hs / 1e6,
+		    s->send / 1e6, s->wait / 1e6, s->recv / 1e6,
+		    backends[s->backend].name);
+	}
+}
+
+/* a counter's increase; one that went down lost what it counted */
+int64_t
+delta(int64_t now, int64_t then)
+{
+	return now > then ? now - then : 0;
+}
+
+/*
+	-M: the target's columns, since the last interval's, in which
+	it answered n requests. CPU is in percent of one core.
+*/
+void
+procreport(int n)
+{
+	struct usage u;
+	int64_t now, ns, usr, sys;
+
+	proctake(&u);
+	now = nsec();
+	ns = now - procns;
+	if(ns <= 0)
+		ns = 1;
+	usr = delta(u.user, procu.user);
+	sys = delta(u.sys, procu.sys);
+	printf("\t%.1f\t%.1f\t%.1f\t%.0f\t%.0f\t%d\t%d\t%.1f",
+	    usr * 100.0 / ns, sys * 100.0 / ns, u.rss / 1e6,
+	    delta(u.vcsw, procu.vcsw) * 1e9 / ns,
+	    delta(u.ivcsw, procu.ivcsw) * 1e9 / ns, u.fds, u.threads,
+	    n > 0 ? (usr + sys) / 1e3 / n : 0.0);
+
+	counts.tcpu += usr + sys;
+	counts.tns += ns;
+	if(u.rss > counts.trss)
+		counts.trss = u.rss;
+	procu = u;
+	procns = now;
+}
+
+void
+chldrec(struct rec *r, void *p, int nprocs)
+{
+	struct slot *sl;
+	struct interval *iv;
+	struct bstat *bs;
+	struct backend *b;
+	struct bslot *bsl, *ssl, *zsl;
+	int i, n, total;
+
+	if(r->n < nreport || r->n - nreport >= NBUFFER)
+		panic("a process fell too far behind\n");
+
+	sl = &slots[r->n % NBUFFER];
+
+	switch(r->type){
+	case Rstep:
+	case Rslat:
+		n = scen != nil ? scen->nsteps : 0;
+		break;
+	case Rsize:
+	case Rzlat:
+		n = params.nsizes;
+		break;
+	default:
+		n = nbackends;
+	}
+	if(r->id >= n)
+		panic("report error\n");
+
+	switch(r->type){
+	case Rlat:
+		histunpack(&sl->lat, p, r->len / sizeof(struct histent));
+		return;
+	case Rhs:
+		histunpack(&sl->hs, p, r->len / sizeof(struct histent));
+		return;
+	case Rklat:
+		histunpack(&sl->klat, p, r->len / sizeof(struct histent));
+		return;
+	case Rblat:
+		histunpack(&sl->b[r->id].lat, p, r->len / sizeof(struct histent));
+		return;
+	case Rbackend:
+		bs = p;
+		sl->b[r->id].st.successes += bs->successes;
+		sl->b[r->id].st.errors += bs->errors;
+		sl->b[r->id].st.timeouts += bs->timeouts;
+		return;
+	case Rslat:
+		histunpack(&sl->s[r->id].lat, p, r->len / sizeof(struct histent));
+		return;
+	case Rslow:
+		for(i=0; i<r->len / sizeof(struct slow); i++)
+			slowpush(sl->slow, &sl->nslow, (struct slow *)p + i);
+		return;
+	case Rstep:
+		bs = p;
+		sl->s[r->id].st.successes += bs->successes;
+		sl->s[r->id].st.errors += bs->errors;
+		sl->s[r->id].st.timeouts += bs->timeouts;
+		return;
+	case Rzlat:
+		histunpack(&sl->z[r->id].lat, p, r->len / sizeof(struct histent));
+		return;
+	case Rsize:
+		bs = p;
+		sl->z[r->id].st.successes += bs->successes;
+		sl->z[r->id].st.errors += bs->errors;
+		sl->z[r->id].st.timeouts += bs->timeouts;
+		return;
+	case Rinterval:
+		break;
+	default:
+		panic("report error\n");
+	}
+
+	iv = p;
+	sl->iv.errors += iv->errors;
+	sl->iv.timeouts += iv->timeouts;
+	sl->iv.closes += iv->closes;
+	sl->iv.successes += iv->successes;
+	for(i=0; i<=params.nbuckets; i++)
+		sl->iv.counters[i] += iv->counters[i];
+	sl->iv.handshakes += iv->handshakes;
+	sl->iv.resumed += iv->resumed;
+	sl->iv.refused += iv->refused;
+	sl->iv.resets += iv->resets;
+	sl->iv.unserved += iv->unserved;
+	sl->iv.held += iv->held;
+	sl->iv.mismatched += iv->mismatched;
+	sl->iv.rxbytes += iv->rxbytes;
+	sl->iv.txbytes += iv->txbytes;
+	if(iv->ns > sl->iv.ns)
+		sl->iv.ns = iv->ns;
+	if(iv->maxlag > sl->iv.maxlag)
+		sl->iv.maxlag = iv->maxlag;
+	if(iv->cpu > sl->iv.cpu)
+		sl->iv.cpu = iv->cpu;
+	sl->iv.loops += iv->loops;
+	sl->iv.callbacks += iv->callbacks;
+
+	if(++sl->nreport < nprocs)
+		return;
+
+	/*
+		Everyone's in; print it. Workers run in lockstep, so
+		slots complete in order.
+	*/
+	iv = &sl->iv;
+	printts(&reporttv);
+	printf("%d\t%d\t%d\t", iv->errors, iv->timeouts, iv->closes);
+	for(i=0; i<=params.nbuckets; i++)
+		printf("%d\t", iv->counters[i]);
+
+	total = iv->successes;
+	printf("%d\t", mkrate(iv->ns, total));
+	printf("%.1f\t%d\t%.1f", iv->maxlag / 1e6, iv->cpu,
+	    iv->loops > 0 ? (double)iv->callbacks / iv->loops : 0.0);
+	if(params.tls)
+		printf("\t%d", mkrate(iv->ns, iv->handshakes));
+	if(params.hold > 0)
+		printf("\t%d", iv->held);
+	if(params.stream || payload != nil)
+		printf("\t%lld\t%lld\t%.1f\t%.1f", (long long)iv->rxbytes,
+		    (long long)iv->txbytes, iv->ns > 0 ? iv->rxbytes * 1e3 / iv->ns : 0.0,
+		    iv->ns > 0 ? iv->txbytes * 1e3 / iv->ns : 0.0);
+	if(procspec != nil)
+		procreport(total);
+	printf("\n");
+	fflush(stdout);
+	if(params.slow > 0)
+		slowreport(sl);
+	live.hz = mkrate(iv->ns, total);
+	live.p50 = histquantile(&sl->lat, 0.5) / 1e6;
+	live.p99 = histquantile(&sl->lat, 0.99) / 1e6;
+
+	/* a spinning worker is always busy */
+	if((iv->cpu >= SAT_CPU && params.ncpus == 0) || iv->maxlag >= SAT_LAG){
+		if(counts.saturated++ == 0)
+			fprintf(stderr, "# warning: hstress is saturated "
+			    "(cpu %d%%, lag %.1fms); results are limited by "
+			    "the generator, not the target\n",
+			    iv->cpu, iv->maxlag / 1e6);
+	}
+
+	/* Aggregate. */
+	counts.errors += iv->errors;
+	counts.timeouts += iv->timeouts;
+	counts.closes += iv->closes;
+	counts.successes += iv->successes;
+	for(i=0; i<=params.nbuckets; i++)
+		counts.counters[i] += iv->counters[i];
+	histmerge(&counts.lat, &sl->lat);
+	counts.handshakes += iv->handshakes;
+	counts.resumed += iv->resumed;
+	counts.refused += iv->refused;
+	counts.resets += iv->resets;
+	counts.unserved += iv->unserved;
+	counts.held = iv->held;
+	counts.mismatched += iv->mismatched;
+	counts.rxbytes += iv->rxbytes;
+	counts.txbytes += iv->txbytes;
+	histmerge(&counts.hs, &sl->hs);
+	histmerge(&counts.klat, &sl->klat);
+	for(i=0; i<nbackends; i++){
+		b = &backends[i];
+		bsl = &sl->b[i];
+		b->st.successes += bsl->st.successes;
+		b->st.errors += bsl->st.errors;
+		b->st.timeouts += bsl->st.timeouts;
+		histmerge(&b->lat, &bsl->lat);
+	}
+	for(i=0; scen != nil && i<scen->nsteps; i++){
+		bsl = &sl->s[i];
+		steps[i].st.successes += bsl->st.successes;
+		steps[i].st.errors += bsl->st.errors;
+		steps[i].st.timeouts += bsl->st.timeouts;
+		histmerge(&steps[i].lat, &bsl->lat);
+	}
+	for(i=0; i<params.nsizes; i++){
+		bsl = &sl->z[i];
+		sizes[i].st.successes += bsl->st.successes;
+		sizes[i].st.errors += bsl->st.errors;
+		sizes[i].st.timeouts += bsl->st.timeouts;
+		histmerge(&sizes[i].lat, &bsl->lat);
+	}
+
+	seriesadd(&ivseries, iv->successes, iv->ns, &sl->lat);
+	if(params.ab)
+		absample(sl);
+	if(!warm.over && (params.warmup > 0 || params.warmreqs > 0 || params.warmsteady))
+		warmup(sl);
+
+	/* Clear it. Advance nreport. */
+	bsl = sl->b;
+	ssl = sl->s;
+	zsl = sl->z;
+	memset(sl, 0, sizeof(*sl));
+	memset(bsl, 0, nbackends * sizeof(*bsl));
+	if(scen != nil)
+		memset(ssl, 0, scen->nsteps * sizeof(*ssl));
+	memset(zsl, 0, params.nsizes * sizeof(*zsl));
+	sl->b = bsl;
+	sl->s = ssl;
+	sl->z = zsl;
+	nreport++;
+}
+
+void
+chldreadcb(struct bufferevent *b, void *arg)
+{
+	struct rec r;
+	static char *buf;
+	static size_t nbuf;
+
+	for(;;){
+		if(evbuffer_copyout(b->input, &r, sizeof(r)) < sizeof(r))
+			break;
+		if(evbuffer_get_length(b->input) < sizeof(r) + r.len)
+			break;
+
+		if(r.len > nbuf){
+			nbuf = r.len;
+			buf = remal(buf, nbuf);
+		}
+		evbuffer_drain(b->input, sizeof(r));
+		evbuffer_remove(b->input, buf, r.len);
+		chldrec(&r, buf, *(int *)arg);
+	}
+
+	bufferevent_enable(b, EV_READ);
+}
+
+void
+chlderrcb(struct bufferevent *b, short what, void *arg)
+{
+	int *nprocs =(int *)arg;
+
+	bufferevent_setcb(b, nil, nil, nil, nil);
+	bufferevent_disable(b, EV_READ | EV_WRITE);
+	bufferevent_free(b);
+	
+	/*if(--(*nprocs) == 0)
+		event_loopbreak();*/
+
+	/* -U: the control socket would keep us going */
+	if(ctlpath != nil && --live.running == 0)
+		event_loopexit(nil);
+}
+
+/*
+	The control socket (-U): a command a line, each answered with
+	a line, "ok", the stats as JSON, or "error" and why.
+
+		concurrency N	loops, in all
+		rate QPS	requests per second, in all; 0 for no limit
+		interval SECS
+		pause
+		resume
+		stats
+
+	Changes go to the workers at once, split among them as -n is.
+*/
+
+struct event	ctlacceptev;
+
+/* to worker i; one that's gone doesn't mind */
+void
+ctlsend(int i, int op, double v)
+{
+	struct ctl m;
+
+	memset(&m, 0, sizeof(m));
+	m.op = op;
+	m.v = v;
+	atomicio(write, live.sockets[i], &m, sizeof(m));
+}
+
+void
+ctlstats(struct evbuffer *out)
+{
+	int64_t ns;
+	int i;
+
+	ns = nsec() - startns;
+	evbuffer_add_printf(out, "{\"elapsed\":%.3f,\"successes\":%d,\"errors\":%d,"
+	    "\"timeouts\":%d,\"closes\":%d,", ns / 1e9, counts.successes,
+	    counts.errors, counts.timeouts, counts.closes);
+	evbuffer_add_printf(out, "\"last\":{\"hz\":%d,\"p50\":%.3f,\"p99\":%.3f},",
+	    live.hz, live.p50, live.p99);
+	evbuffer_add_printf(out, "\"total\":{\"hz\":%d", mkrate(ns, counts.successes));
+	for(i=Sp50; i<Nstat; i++)
+		evbuffer_add_printf(out, ",\"%s\":%.3f", statnames[i],
+		    histquantile(&counts.lat, statq[i]) / 1e6);
+	evbuffer_add_printf(out, "},\"concurrency\":%d,\"rate\":%g,\"paused\":%s,"
+	    "\"interval\":%g}\n", live.concurrency, live.rate,
+	    live.paused ? "true" : "false", reporttv.tv_sec + reporttv.tv_usec / 1e6);
+}
+
+/* One command; the reply goes to out. */
+void
+ctlcmd(char *line, struct evbuffer *out)
+{
+	char *cmd, *arg, *end;
+	double v;
+	int i, n, ok;
+
+	arg = line;
+	cmd = strsep(&arg, " \t");
+	v = 0;
+	ok = 0;
+	if(arg != nil){
+		v = strtod(arg, &end);
+		ok = end != arg && *end == '\0';
+	}
+
+	if(strcmp(cmd, "stats") == 0){
+		ctlstats(out);
+		return;
+	}else if(strcmp(cmd, "pause") == 0){
+		live.paused = 1;
+		for(i=0; i<live.nw; i++)
+			ctlsend(i, Cpause, 0);
+	}else if(strcmp(cmd, "resume") == 0){
+		live.paused = 0;
+		for(i=0; i<live.nw; i++)
+			ctlsend(i, Cresume, 0);
+	}else if(strcmp(cmd, "concurrency") == 0){
+		n = v;
+		if(!ok || n != v || n < 0){
+			evbuffer_add_printf(out, "error: concurrency N, N a whole number\n");
+			return;
+		}
+		if(params.ab && n % (2*live.nw) != 0){
+			evbuffer_add_printf(out, "error: -B splits it evenly; "
+			    "give a multiple of %d\n", 2*live.nw);
+			return;
+		}
+		live.concurrency = n;
+		for(i=0; i<live.nw; i++)
+			ctlsend(i, Cconcurrency, n / live.nw + (i < n % live.nw));
+	}else if(strcmp(cmd, "rate") == 0){
+		if(!ok || v < 0){
+			evbuffer_add_printf(out, "error: rate QPS, 0 for no limit\n");
+			return;
+		}
+		live.rate = v;
+		for(i=0; i<live.nw; i++)
+			ctlsend(i, Crate, v / live.nw);
+	}else if(strcmp(cmd, "interval") == 0){
+		if(!ok || v < 0.01){
+			evbuffer_add_printf(out, "error: interval SECS, at least 0.01\n");
+			return;
+		}
+		reporttv.tv_sec = v;
+		reporttv.tv_usec = (v - reporttv.tv_sec) * 1e6 + 0.5;
+		for(i=0; i<live.nw; i++)
+			ctlsend(i, Cinterval, v);
+	}else{
+		evbuffer_add_printf(out, "error: unknown command \"%s\"\n", cmd);
+		return;
+	}
+	evbuffer_add_printf(out, "ok\n");
+}
+
+void
+ctlclose(struct bufferevent *b)
+{
+	close(bufferevent_getfd(b));
+	bufferevent_free(b);
+}
+
+void
+ctlreadcb(struct bufferevent *b, void *arg)
+{
+	char *line;
+
+	while((line = evbuffer_readln(b->input, nil, EVBUFFER_EOL_ANY)) != nil){
+		if(*line != '\0')
+			ctlcmd(line, b->output);
+		free(line);
+	}
+}
+
+/* what's still to be said is said before we hang up */
+void
+ctldrainedcb(struct bufferevent *b, void *arg)
+{
+	ctlclose(b);
+}
+
+void
+ctlerrcb(struct bufferevent *b, short what, void *arg)
+{
+	if((what & EVBUFFER_EOF) && evbuffer_get_length(b->output) > 0){
+		bufferevent_disable(b, EV_READ);
+		bufferevent_setcb(b, nil, ctldrainedcb, ctlerrcb, nil);
+		return;
+	}
+	ctlclose(b);
+}
+
+void
+ctlacceptcb(int lfd, short what, void *arg)
+{
+	struct bufferevent *b;
+	int fd;
+
+	while((fd = accept(lfd, nil, nil)) >= 0){
+		evutil_make_socket_nonblocking(fd);
+		b = bufferevent_new(fd, ctlreadcb, nil, ctlerrcb, nil);
+		bufferevent_enable(b, EV_READ);
+	}
+}
+
+void
+ctllisten(int nprocs, int *sockets)
+{
+	struct sockaddr_storage ss;
+	char buf[512];
+	int fd;
+
+	live.sockets = sockets;
+	live.nw = live.running = nprocs;
+	live.concurrency = params.concurrency * nprocs;
+
+	snprintf(buf, sizeof(buf), "unix:%s", ctlpath);
+	netaddr(buf, 0, &ss);
+	if((fd = netlisten(&ss)) < 0)
+		panic("control socket %s: %s", ctlpath, strerror(errno));
+	event_set(&ctlacceptev, fd, EV_READ|EV_PERSIST, ctlacceptcb, nil);
+	event_add(&ctlacceptev, nil);
+}
+
+void
+parentd(int nprocs, int *sockets)
+{
+	int *fdp, i, status;
+	pid_t pid;
+	struct bufferevent *b;
+	
+	signal(SIGINT, sigint);
+
+	startns = nsec();
+	if(procspec != nil){
+		proctake(&procu);
+		procns = startns;
+	}
+	memset(slots, 0, sizeof(slots));
+	for(i=0; i<NBUFFER; i++){
+		if((slots[i].b = calloc(nbackends, sizeof(struct bslot))) == nil)
+			panic("calloc");
+		if(scen != nil && (slots[i].s = calloc(scen->nsteps, sizeof(struct bslot))) == nil)
+			panic("calloc");
+		if((slots[i].z = calloc(params.nsizes + 1, sizeof(struct bslot))) == nil)
+			panic("calloc");
+	}
+
+	event_init();
+	if(ctlpath != nil)
+		ctllisten(nprocs, sockets);
+
+	for(fdp=sockets; *fdp!=-1; fdp++){
+		b = bufferevent_new(
+		    *fdp, chldreadcb, nil, 
+		    chlderrcb,(void *)&nprocs);
+		bufferevent_enable(b, EV_READ);
+	}
+
+	event_dispatch();
+
+	for(i=0; i<nprocs; i++)
+		pid = waitpid(0, &status, 0);
+		
+	report();
+}
+
+void
+sigint(int which)
+{
+	report();
+	exit(0);
+}
+
+void
+printcount(const char *name, int total, int count)
+{
+	fprintf(stderr, "# %s", name);
+	if(total > 0)
+		fprintf(stderr, "\t%d\t%.02f", count,(1.0f*count) /(1.0f*total));
+	
+	fprintf(stderr, "\n");
+}
+
+void
+printquantile(const char *name, struct hist *h, double q)
+{
+	fprintf(stderr, "# %s\t\t%.3f\n", name, histquantile(h, q) / 1e6);
+}
+
+/* stat k of the run, and its confidence interval if we have one */
+void
+printstat(int k, double v)
+{
+	fprintf(stderr, k == Shz ? "# %s\t\t%.0f" : "# %s\t\t%.3f", statnames[k], v);
+	if(ivseries.n >= 2)
+		fprintf(stderr, k == Shz ? "\t±%.0f" : "\t±%.3f", ci95(k));
+	fprintf(stderr, "\n");
+}
+
+void
+report()
+{
+	char buf[128];
+	int i, total = counts.successes + counts.errors + counts.timeouts;
+	struct backend *b;
+	int64_t ns;
+
+	if(params.warmup > 0 || params.warmreqs > 0 || params.warmsteady){
+		if(warm.over)
+			fprintf(stderr, "# warm-up\t%d intervals, %d requests; %s\n",
+			    warm.intervals, warm.requests, ivseries.n > 0 ?
+			    "not counted below" : "that was the whole run");
+		else
+			fprintf(stderr, "# warm-up\tnever over%s; counted below\n",
+			    params.warmsteady ? ": the run was never steady" : "");
+	}
+
+	total += counts.unserved;
+	printcount("successes", total, counts.successes);
+	printcount("errors", total, counts.errors);
+	printcount("timeouts", total, counts.timeouts);
+	if(params.crate > 0){
+		/* the errors by kind, and what the accept loop never got to */
+		printcount("refused", total, counts.refused);
+		printcount("reset", total, counts.resets);
+		printcount("other", total, counts.errors - counts.refused - counts.resets);
+		printcount("unserved", total, counts.unserved);
+	}
+	printcount("closes", total, counts.closes);
+	if(params.checksum)
+		printcount("mismatched", total, counts.mismatched);
+	for(i=0; params.buckets[i]!=0; i++){
+		snprintf(buf, sizeof(buf), "<%d\t", params.buckets[i]);
+		printcount(buf, total, counts.counters[i]);
+	}
+	
+	snprintf(buf, sizeof(buf), ">=%d\t", params.buckets[i - 1]);
+	printcount(buf, total, counts.counters[i]);
+
+	/* the ± are 95% confidence intervals, from the intervals' spread */
+	for(i=Sp50; i<Nstat; i++)
+		printstat(i, histquantile(&counts.lat, statq[i]) / 1e6);
+
+	/* the rest of p is ours: scheduling, the event loop, parsing */
+	if(params.kts){
+		printquantile("k-p50", &counts.klat, 0.5);
+		printquantile("k-p90", &counts.klat, 0.9);
+		printquantile("k-p99", &counts.klat, 0.99);
+		printquantile("k-p99.9", &counts.klat, 0.999);
+	}
+	
+	/* no total */
+	ns = nsec() - startns;
+	printstat(Shz, mkrate(ns, counts.successes));
+	driftreport();
+
+	if(params.tls){
+		fprintf(stderr, "# handshakes\t%d\n", counts.handshakes);
+		printcount("resumed", counts.handshakes, counts.resumed);
+		printquantile("hs-p50", &counts.hs, 0.5);
+		printquantile("hs-p99", &counts.hs, 0.99);
+		printquantile("hs-p99.9", &counts.hs, 0.999);
+		fprintf(stderr, "# hs-hz\t\t%d\n", mkrate(ns, counts.handshakes));
+	}
+
+	if(nbackends > 1){
+		fprintf(stderr, "# backend\tsuccess\terrors\ttimeout\thz\tp50\tp99\tp99.9\n");
+		for(i=0; i<nbackends; i++){
+			b = &backends[i];
+			fprintf(stderr, "# %s\t%d\t%d\t%d\t%d\t%.3f\t%.3f\t%.3f\n",
+			    b->name, b->st.successes, b->st.errors, b->st.timeouts,
+			    mkrate(ns, b->st.successes),
+			    histquantile(&b->lat, 0.5) / 1e6,
+			    histquantile(&b->lat, 0.99) / 1e6,
+			    histquantile(&b->lat, 0.999) / 1e6);
+		}
+	}
+
+	/* the last step's successes are whole sessions */
+	if(scen != nil){
+		fprintf(stderr, "# sessions\t%d\t%d/s\n", steps[scen->nsteps - 1].st.successes,
+		    mkrate(ns, steps[scen->nsteps - 1].st.successes));
+		fprintf(stderr, "# step\tsuccess\terrors\ttimeout\thz\tp50\tp99\tp99.9\n");
+		for(i=0; i<scen->nsteps; i++){
+			fprintf(stderr, "# %d\t%d\t%d\t%d\t%d\t%.3f\t%.3f\t%.3f\t%s\n",
+			    i + 1, steps[i].st.successes, steps[i].st.errors,
+			    steps[i].st.timeouts, mkrate(ns, steps[i].st.successes),
+			    histquantile(&steps[i].lat, 0.5) / 1e6,
+			    histquantile(&steps[i].lat, 0.99) / 1e6,
+			    histquantile(&steps[i].lat, 0.999) / 1e6,
+			    scen->steps[i].name);
+		}
+	}
+
+	/* bodies only: the heads are small, and the same for all */
+	if(params.nsizes > 0){
+		fprintf(stderr, "# size\tsuccess\terrors\ttimeout\thz\tMB/s\tp50\tp99\tp99.9\n");
+		for(i=0; i<params.nsizes; i++){
+			fprintf(stderr, "# %lld\t%d\t%d\t%d\t%d\t%.1f\t%.3f\t%.3f\t%.3f\n",
+			    (long long)params.sizes[i], sizes[i].st.successes,
+			    sizes[i].st.errors, sizes[i].st.timeouts,
+			    mkrate(ns, sizes[i].st.successes),
+			    ns > 0 ? params.sizes[i] * sizes[i].st.successes * 1e3 / ns : 0.0,
+			    histquantile(&sizes[i].lat, 0.5) / 1e6,
+			    histquantile(&sizes[i].lat, 0.99) / 1e6,
+			    histquantile(&sizes[i].lat, 0.999) / 1e6);
+		}
+	}
+
+	if(params.hold > 0)
+		fprintf(stderr, "# held\t\t%d\n", counts.held);
+	if(params.stream || payload != nil){
+		fprintf(stderr, "# rx\t\t%lld\n", (long long)counts.rxbytes);
+		fprintf(stderr, "# tx\t\t%lld\n", (long long)counts.txbytes);
+		fprintf(stderr, "# MB/s in\t%.1f\n", ns > 0 ? counts.rxbytes * 1e3 / ns : 0.0);
+		fprintf(stderr, "# MB/s out\t%.1f\n", ns > 0 ? counts.txbytes * 1e3 / ns : 0.0);
+	}
+
+	if(params.ab)
+		abreport();
+
+	/* the target's CPU per request, to plan capacity with */
+	if(procspec != nil){
+		fprintf(stderr, "# t-cpu\t\t%.1f%%\n", counts.tns > 0 ?
+		    counts.tcpu * 100.0 / counts.tns : 0.0);
+		fprintf(stderr, "# t-us/req\t%.1f\n",
+		    counts.successes > 0 ? counts.tcpu / 1e3 / counts.successes : 0.0);
+		fprintf(stderr, "# t-rss max\t%.1f\n", counts.trss / 1e6);
+	}
+
+	if(counts.saturated > 0)
+		fprintf(stderr, "# saturated\t%d intervals\n", counts.saturated);
+}
+
+/*
+	Main, dispatch.
+*/
+
+/*
+	Parse a comma-separated list of source addresses into srcs.
+	IPv4 entries may be prefixes, a.b.c.d/len, which stand for
+	every host address in them.
+*/
+void
+parsesrcs(char *spec)
+{
+	char *ap, *len;
+	struct sockaddr_in *sin;
+	struct sockaddr_in6 *sin6;
+	struct in_addr a;
+	uint32_t base, n, i;
+	int bits;
+
+	if((srcs = calloc(MAX_SRCS, sizeof(*srcs))) == nil)
+		panic("calloc");
+
+	while((ap = strsep(&spec, ",")) != nil){
+		if(*ap == '\0')
+			continue;
+
+		sin6 = (struct sockaddr_in6 *)&srcs[nsrcs];
+		if(inet_pton(AF_INET6, ap, &sin6->sin6_addr) == 1){
+			if(nsrcs >= MAX_SRCS)
+				panic("too many source addresses");
+			sin6->sin6_family = AF_INET6;
+			nsrcs++;
+			continue;
+		}
+
+		bits = 32;
+		if((len = strchr(ap, '/')) != nil){
+			*len++ = '\0';
+			bits = atoi(len);
+			if(bits < 1 || bits > 32)
+				panic("bad prefix length in \"%s\"", ap);
+		}
+		if(inet_pton(AF_INET, ap, &a) != 1)
+			panic("bad source address \"%s\"", ap);
+
+		n = bits == 32 ? 1 : (uint32_t)1 << (32 - bits);
+		base = ntohl(a.s_addr) & ~(n - 1);
+		/* skip the network and broadcast addresses, but of a /31 or /32 */
+		for(i = n > 2; i < n - (n > 2); i++){
+			if(nsrcs >= MAX_SRCS)
+				panic("too many source addresses");
+			sin = (struct sockaddr_in *)&srcs[nsrcs++];
+			sin->sin_family = AF_INET;
+			sin->sin_addr.s_addr = htonl(base + i);
+		}
+		if(bits == 32)
+			((struct sockaddr_in *)&srcs[nsrcs-1])->sin_addr = a;
+	}
+}
+
+/* Parse socket options: nodelay,linger,sndbuf=N,rcvbuf=N */
+void
+parseopts(char *spec)
 {
-	int milliseconds;
-	struct timeval now, diff;
+	char *ap;
+
+	while((ap = strsep(&spec, ",")) != nil){
+		if(strcmp(ap, "nodelay") == 0)
+			params.nodelay = 1;
+		else if(strcmp(ap, "linger") == 0)
+			params.linger = 1;
+		else if(strncmp(ap, "sndbuf=", 7) == 0)
+			params.sndbuf = atoi(ap + 7);
+		else if(strncmp(ap, "rcvbuf=", 7) == 0)
+			params.rcvbuf = atoi(ap + 7);
+		else if(strncmp(ap, "busypoll=", 9) == 0)
+			params.busypoll = atoi(ap + 9);
+		else if(*ap != '\0')
+			panic("unknown socket option \"%s\"", ap);
+	}
+}
 
-	gettimeofday(&now, nil);
-	timersub(&now, tv, &diff);
-	milliseconds = diff.tv_sec * 1000 + diff.tv_usec / 1000;
-	*tv = now;
+/* CPUS: a comma-separated list of CPUs and ranges, like 2-5,8 */
+void
+parsecpus(char *spec)
+{
+	char *ap, *e;
+	int lo, hi;
 
-	return(1000 * count / milliseconds);
+	params.ncpus = 0;
+	while((ap = strsep(&spec, ",")) != nil){
+		if(*ap == '\0')
+			continue;
+		lo = hi = strtol(ap, &e, 10);
+		if(*e == '-')
+			hi = strtol(e + 1, &e, 10);
+		if(*e != '\0' || lo < 0 || hi < lo)
+			panic("bad cpu \"%s\"", ap);
+		for(; lo <= hi; lo++){
+			if(params.ncpus >= MAX_CPUS)
+				panic("too many cpus");
+			params.cpus[params.ncpus++] = lo;
+		}
+	}
 }
 
+/*
+	Add a target. It's resolved once, here, and its request built
+	with the right Host: header.
+*/
 void
-reportcb(int fd, short what, void *arg)
+addtarget(char *host, int port, int weight)
 {
-	struct timeval now, diff;
-	int i, count, milliseconds;
+	struct backend *b;
+	struct in_addr in;
+	struct in6_addr in6;
+	char *hosthdr;
+	uint8_t *p;
+	size_t n;
 
-	printf("%d\t", nreport++);
-	printf("%d\t", counts.errors);
-	printf("%d\t", counts.timeouts);
-	printf("%d\t", counts.closes);
-	
-	counts.errors = counts.timeouts = counts.closes = 0;
+	if(nbackends >= MAX_TARGETS)
+		panic("too many targets");
+	if(weight < 1)
+		panic("bad weight for %s", host);
 
-	for(i=0; params.buckets[i]!=0; i++)
-		printf("%d\t", counts.counters[i]);
+	b = &backends[nbackends++];
+	netaddr(host, port, &b->addr);
 
-	printf("%d\n", counts.counters[i]);
-	fflush(stdout);
+	if(isunix(host))
+		snprintf(b->name, sizeof(b->name), "%s", host);
+	else if(strchr(host, ':') != nil)
+		snprintf(b->name, sizeof(b->name), "[%s]:%d", host, port);
+	else
+		snprintf(b->name, sizeof(b->name), "%s:%d", host, port);
 
-	memset(counts.counters, 0, sizeof(counts.counters));
+	/* SNI is for names, not addresses */
+	if(!isunix(host) && inet_pton(AF_INET, host, &in) != 1 &&
+	    inet_pton(AF_INET6, host, &in6) != 1)
+		snprintf(b->sni, sizeof(b->sni), "%s", host);
 
-	if(params.count<0 || counts.successes<params.count)
-		evtimer_add(&reportev, &reporttv);
+	/* a Unix socket has no authority of its own */
+	hosthdr = isunix(host) ? "localhost" : b->name;
+
+	b->weight = weight;
+	b->nreq = strlen(hosthdr) + 32;
+	b->req = mal(b->nreq);
+	b->nreq = snprintf(b->req, b->nreq, "GET / HTTP/1.1\r\nHost: %s\r\n\r\n", hosthdr);
+
+	/* :authority as a literal to be indexed; see h2dispatch */
+	n = strlen(hosthdr);
+	p = b->h2req;
+	*p++ = 0x41;
+	p += hpackint(p, 7, 0, n);
+	memcpy(p, hosthdr, n);
+	b->nh2req = p + n - b->h2req;
+	b->h2entry = 32 + strlen(":authority") + n;
+	LIST_INIT(&b->idle);
+	LIST_INIT(&b->h2s);
 }
 
 /*
-	HTTP, via libevent's HTTP support.
+	Parse a target list: HOST:PORT[=WEIGHT],... IPv6 addresses
+	go in brackets; unix:PATH[=WEIGHT] is a Unix domain socket.
 */
-
-struct evhttp_connection *
-mkhttp()
+void
+parsetargets(char *spec)
 {
-	struct evhttp_connection *evcon;
+	char *ap, *host, *port, *w;
+
+	while((ap = strsep(&spec, ",")) != nil){
+		if(*ap == '\0')
+			continue;
 
-	evcon = evhttp_connection_new(http_hostname, http_port);
-	if(evcon == nil)
-		panic("evhttp_connection_new");
+		if((w = strchr(ap, '=')) != nil)
+			*w++ = '\0';
 
-	evhttp_connection_set_closecb(evcon, &closecb, nil);
-	/*
-		note: we manage our own per-request timeouts, since the underlying
-		library does not give us enough error reporting fidelity
-	*/
-	
-	/* also set some socket options manually. */
-	
+		host = ap;
+		if(isunix(host))
+			port = nil;
+		else if(*host == '['){
+			host++;
+			if((port = strchr(host, ']')) == nil)
+				panic("bad target \"%s\"", ap);
+			*port++ = '\0';
+			if(*port == ':')
+				port++;
+		}else if((port = strrchr(host, ':')) != nil)
+			*port++ = '\0';
 
-	return(evcon);
+		addtarget(host, port != nil && *port != '\0' ? atoi(port) : 80,
+		    w != nil ? atoi(w) : 1);
+	}
 }
 
-void
-dispatch(struct evhttp_connection *evcon, int reqno)
-{
-	struct evhttp_request *evreq;
-	struct request *req;
+/*
+	Distribution. A coordinator (-C) stands in for the parent of
+	the workers of agents (-A) elsewhere: an agent fetches the run
+	from it, and each of its workers reports to it over a TCP
+	connection of its own, exactly as it would over a socketpair.
+	Records are in host order and layout, so agents must be the
+	same build, on the same architecture; the hello checks that.
+*/
 
-	if((req = calloc(1, sizeof(*req))) == nil)
-		panic("calloc");
+#define HELLO_MAGIC	0x68737472	/* "hstr" */
+#define START_DELAY	250000000LL	/* ns; time for the start to reach everyone */
 
-	req->evcon = evcon;
-	req->evcon_reqno = reqno;
+enum{	/* hello kinds */
+	Hagent = 1,
+	Hworker,
+};
 
-	evreq = evhttp_request_new(&recvcb, req);
-	if(evreq == nil)
-		panic("evhttp_request_new");
+struct hello{
+	uint32_t magic;
+	uint32_t kind;
+	uint32_t ivsize;	/* sizeof(struct interval) */
+	uint32_t psize;		/* sizeof(params) */
+};
 
-	req->evreq = evreq;
+/* the run, to an agent; params and the -t targets follow */
+struct run{
+	uint32_t magic;
+	int32_t agent;		/* which one it is */
+	int32_t nagents;
+	int32_t nprocs;		/* workers per agent */
+	int32_t ntargets;	/* length of the targets, with its NUL */
+	struct timeval reporttv;
+};
 
-	evreq->response_code = -1;
-	evhttp_add_header(evreq->output_headers, "Host", http_hosthdr);
+/* HOST:PORT, or [HOST]:PORT; a bare PORT leaves *host alone. */
+int
+hostport(char *spec, char **host)
+{
+	char *p;
 
-	gettimeofday(&req->starttv, nil);
-	evtimer_set(&req->timeoutev, timeoutcb,(void *)req);
-	evtimer_add(&req->timeoutev, &timeouttv);
+	if(*spec == '['){
+		*host = spec + 1;
+		if((p = strchr(spec, ']')) == nil)
+			panic("bad address \"%s\"", spec);
+		*p++ = '\0';
+		if(*p == ':')
+			p++;
+	}else if((p = strrchr(spec, ':')) != nil){
+		*host = spec;
+		*p++ = '\0';
+	}else
+		p = spec;
 
-	evhttp_make_request(evcon, evreq, EVHTTP_REQ_GET, "/");
+	if(atoi(p) <= 0)
+		panic("bad port in \"%s\"", spec);
+	return atoi(p);
 }
 
+/* Sleep until the wall clock reads t (ns). */
 void
-dispatchcb(int fd, short what, void *arg)
+sleepuntil(int64_t t)
 {
-	free(arg);
-	dispatch(mkhttp(), 1);
+	struct timespec ts;
+
+	ts.tv_sec = t / 1000000000;
+	ts.tv_nsec = t % 1000000000;
+	while(clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &ts, nil) == EINTR)
+		;
 }
 
-void
-complete(int how, struct request *req)
+/* A blocking connection to the coordinator, hello said. */
+int
+coorddial(char *spec, int kind)
 {
-	struct timeval now, diff;
-	int i, total;
-	long milliseconds;
-	struct event *timeoutev;
+	struct sockaddr_storage ss;
+	struct hello h;
+	char buf[256], *host = "127.0.0.1";
+	int fd, port;
 
-	evtimer_del(&req->timeoutev);
+	Scp(buf, spec, sizeof(buf));
+	port = hostport(buf, &host);
+	netaddr(host, port, &ss);
 
-	switch(how){
-	case Success:
-		gettimeofday(&now, nil);
-		timersub(&now, &req->starttv, &diff);
-		milliseconds = diff.tv_sec * 1000 + diff.tv_usec / 1000;
-		for(i=0; params.buckets[i]<milliseconds &&
-		    params.buckets[i]!=0; i++);
-		counts.counters[i]++;
-		counts.successes++;
-		break;
-	case Error:
-		counts.errors++;
-		break;
-	case Timeout:
-		counts.timeouts++;
-		break;
-	}
+	if((fd = socket(ss.ss_family, SOCK_STREAM, 0)) < 0 ||
+	    connect(fd, (struct sockaddr *)&ss, sslen(&ss)) < 0)
+		panic("coordinator %s: %s", spec, strerror(errno));
 
-	total =
-	    counts.successes + counts.errors + 
-	    counts.timeouts /*+ counts.closes*/;
-	/* enqueue the next one */
-	if(params.count<0 || total<params.count){
-		if(params.rpc<0 || params.rpc>req->evcon_reqno){
-			dispatch(req->evcon, req->evcon_reqno+1);
-		}else{
-			/* There seems to be a bug in libevent where the connection isn't really
-			 * freed until the event loop is unwound. We'll add ourselves back with a 
-			 * 0-second timeout. */
-			evhttp_connection_free(req->evcon);
-			timeoutev = mal(sizeof(*timeoutev));
-			evtimer_set(timeoutev, dispatchcb, (void *)timeoutev);
-			evtimer_add(timeoutev, &zerotv);
-		}
-	}else{
-		/* We'll count this as a close. I guess that's ok. */
-		evhttp_connection_free(req->evcon);
-		if(--params.concurrency == 0){
-			evtimer_del(&reportev);
-			reportcb(0, 0, nil);  /* issue a last report */
-		}
-	}
-	
-	free(req);
+	h.magic = HELLO_MAGIC;
+	h.kind = kind;
+	h.ivsize = sizeof(struct interval);
+	h.psize = sizeof(params);
+	if(atomicio(write, fd, &h, sizeof(h)) != sizeof(h))
+		panic("coordinator %s: hello", spec);
+
+	return fd;
 }
 
-void
-recvcb(struct evhttp_request *evreq, void *arg)
+/*
+	Take the run from the coordinator at spec. Returns the number
+	of workers to start; *agent is our number among *nagents.
+*/
+int
+join(char *spec, int *agent, int *nagents)
 {
+	struct run run;
+	char *targets;
+	int fd;
 
-	int status = Success;
+	fd = coorddial(spec, Hagent);
+	if(atomicio(read, fd, &run, sizeof(run)) != sizeof(run) ||
+	    run.magic != HELLO_MAGIC)
+		panic("coordinator %s turned us away", spec);
 
-	/* 
-		It seems that, under certain circumstances, 
-		evreq may be null on failure.  
+	targets = mal(run.ntargets);
+	if(atomicio(read, fd, &params, sizeof(params)) != sizeof(params) ||
+	    atomicio(read, fd, targets, run.ntargets) != run.ntargets)
+		panic("coordinator %s: short run", spec);
+	close(fd);
 
-		we'll count it as an error.
-		
-		it seems this happens when we run out of fds-- warn?
-	*/
-
-	if(evreq == nil || evreq->response_code < 0){
-		status = Error;
-	}
+	targets[run.ntargets - 1] = '\0';
+	parsetargets(targets);
+	free(targets);
 
-	complete(status,(struct request *)arg);
+	reporttv = run.reporttv;
+	*agent = run.agent;
+	*nagents = run.nagents;
+	return run.nprocs;
 }
 
-void
-timeoutcb(int fd, short what, void *arg)
+/* A worker's report connection; returns when it is time to start. */
+int
+joinrun(char *spec)
 {
-	struct request *req =(struct request *)arg;
-	
-	/* re-establish the connection */
-	evhttp_connection_free(req->evcon);
-	req->evcon = mkhttp();
+	int64_t start;
+	int fd;
 
-	complete(Timeout, req);
-}
+	fd = coorddial(spec, Hworker);
+	if(atomicio(read, fd, &start, sizeof(start)) != sizeof(start))
+		panic("coordinator %s: no start", spec);
+	sleepuntil(start);
 
-void
-closecb(struct evhttp_connection *evcon, void *arg)
-{
-	counts.closes++;
+	return fd;
 }
 
-
 /*
-	Aggregation.
+	Wait at spec for nagents agents and all of their nprocs
+	workers, then start them together. The workers' connections
+	go in sockets, for parentd.
 */
-
 void
-chldreadcb(struct bufferevent *b, void *arg)
+coordinate(char *spec, int nagents, int nprocs, int *sockets)
 {
-	char *line, *sp, *ap;
-	int n, i, total, nprocs = *(int *)arg;
-
-	if((line=evbuffer_readline(b->input)) != nil){
-		sp = line;
-
-		if((ap = strsep(&sp, "\t")) == nil)
-			panic("report error\n");
-		n = atoi(ap);
-		if(n - nreport > NBUFFER)
-			panic("a process fell too far behind\n");
-
-		n %= NBUFFER;
-
-		for(i=0; i<params.nbuckets + 3 && (ap=strsep(&sp, "\t")) != nil; i++)
-			reportbuf[n][i] += atoi(ap);
-
-		if(++nreportbuf[n] >= nprocs){
-			/* Timestamp it.  */
-			printf("%d\t",(int)time(nil));
-			for(i = 0; i < params.nbuckets + 3; i++)
-				printf("%d\t", reportbuf[n][i]);
-
-			/* Compute the total rate of succesful requests. */
-			total = 0;
-			for(i=3; i<params.nbuckets+1; i++)
-				total += reportbuf[n][i];
-
-			printf("%d\n", mkrate(&lastreporttv, total));
-			
-			/* Aggregate. */
-			counts.errors += reportbuf[n][0];
-			counts.timeouts += reportbuf[n][1];
-			counts.closes += reportbuf[n][2];
-			for(i=0; i<params.nbuckets; i++){
-				counts.successes += reportbuf[n][i + 3];
-				counts.counters[i] += reportbuf[n][i + 3];
-			}
+	struct sockaddr_storage ss;
+	struct hello h;
+	struct run run;
+	char *host = "0.0.0.0", *targets, *p;
+	int i, fd, lfd, port, nagent = 0, nworker = 0;
+	int64_t start;
+	size_t n;
 
-			/* Clear it. Advance nreport. */
-			memset(reportbuf[n], 0,(params.nbuckets + 3) * sizeof(int));
-			nreportbuf[n] = 0;
-			nreport++;
-		}
+	fprintf(stderr, "# waiting for %d agents on %s\n", nagents, spec);
 
-		free(line);
-	}
+	port = hostport(spec, &host);
+	netaddr(host, port, &ss);
+	if((lfd = netlisten(&ss)) < 0)
+		panic("listen: %s", strerror(errno));
+	fcntl(lfd, F_SETFL, 0);
 
-	bufferevent_enable(b, EV_READ);
-}
+	/* the targets, as -t would have them */
+	n = nbackends * (sizeof(backends[0].name) + 16);
+	p = targets = mal(n);
+	for(i=0; i<nbackends; i++)
+		p += snprintf(p, n - (p - targets), "%s=%d,",
+		    backends[i].name, backends[i].weight);
 
-void
-chlderrcb(struct bufferevent *b, short what, void *arg)
-{
-	int *nprocs =(int *)arg;
+	memset(&run, 0, sizeof(run));
+	run.magic = HELLO_MAGIC;
+	run.nagents = nagents;
+	run.nprocs = nprocs;
+	run.ntargets = p - targets + 1;
+	run.reporttv = reporttv;
 
-	bufferevent_setcb(b, nil, nil, nil, nil);
-	bufferevent_disable(b, EV_READ | EV_WRITE);
-	bufferevent_free(b);
-	
-	/*if(--(*nprocs) == 0)
-		event_loopbreak();*/
-}
+	while(nagent < nagents || nworker < nagents*nprocs){
+		if((fd = accept(lfd, nil, nil)) < 0){
+			if(errno == EINTR || errno == ECONNABORTED)
+				continue;
+			panic("accept: %s", strerror(errno));
+		}
 
-void
-parentd(int nprocs, int *sockets)
-{
-	int *fdp, i, status, size;
-	pid_t pid;
-	struct bufferevent *b;
-	
-	signal(SIGINT, sigint);
+		if(atomicio(read, fd, &h, sizeof(h)) != sizeof(h) ||
+		    h.magic != HELLO_MAGIC || h.ivsize != sizeof(struct interval) ||
+		    h.psize != sizeof(params)){
+			fprintf(stderr, "# turned away a stranger\n");
+			close(fd);
+			continue;
+		}
 
-	gettimeofday(&ratetv, nil);
-	gettimeofday(&lastreporttv, nil);
-	memset(nreportbuf, 0, sizeof(nreportbuf));
-	for(i=0; i<NBUFFER; i++){
-		if((reportbuf[i] = calloc(params.nbuckets + 3, sizeof(int))) == nil)
-			panic("calloc");
+		if(h.kind == Hagent && nagent < nagents){
+			run.agent = nagent;
+			if(atomicio(write, fd, &run, sizeof(run)) == sizeof(run) &&
+			    atomicio(write, fd, &params, sizeof(params)) == sizeof(params) &&
+			    atomicio(write, fd, targets, run.ntargets) == run.ntargets)
+				nagent++;
+			close(fd);
+		}else if(h.kind == Hworker && nworker < nagents*nprocs)
+			sockets[nworker++] = fd;
+		else
+			close(fd);
 	}
+	close(lfd);
+	free(targets);
 
-	event_init();
-
-	for(fdp=sockets; *fdp!=-1; fdp++){
-		b = bufferevent_new(
-		    *fdp, chldreadcb, nil, 
-		    chlderrcb,(void *)&nprocs);
-		bufferevent_enable(b, EV_READ);
+	start = realnsec() + START_DELAY;
+	for(i=0; i<nworker; i++){
+		if(atomicio(write, sockets[i], &start, sizeof(start)) != sizeof(start))
+			panic("start: %s", strerror(errno));
 	}
+	sockets[nworker] = -1;
 
-	event_dispatch();
-
-	for(i=0; i<nprocs; i++)
-		pid = waitpid(0, &status, 0);
-		
-	report();
+	sleepuntil(start);
 }
 
-void
-sigint(int which)
+/* A number of bytes, with k, m or g for their powers of 1024. */
+int64_t
+parsebytes(char *s, char **end)
 {
-	report();
-	exit(0);
-}
+	int64_t n;
 
-void
-printcount(const char *name, int total, int count)
-{
-	fprintf(stderr, "# %s", name);
-	if(total > 0)
-		fprintf(stderr, "\t%d\t%.02f", count,(1.0f*count) /(1.0f*total));
-	
-	fprintf(stderr, "\n");
+	n = strtoll(s, end, 10);
+	switch(**end){
+	case 'k':
+	case 'K':
+		n <<= 10;
+		(*end)++;
+		break;
+	case 'm':
+	case 'M':
+		n <<= 20;
+		(*end)++;
+		break;
+	case 'g':
+	case 'G':
+		n <<= 30;
+		(*end)++;
+		break;
+	}
+	return n;
 }
 
+/*
+	The bodies, -d or -D: a file's contents, or as many bytes as
+	the largest body, of letters that won't compress to nothing.
+*/
 void
-report()
+mkpayload()
 {
-	char buf[128];
-	int i, total = counts.successes + counts.errors + counts.timeouts;
+	FILE *f;
+	size_t i;
+	uint32_t x = 2463534242u;
 
-	printcount("successes", total, counts.successes);
-	printcount("errors", total, counts.errors);
-	printcount("timeouts", total, counts.timeouts);
-	printcount("closes", total, counts.closes);
-	for(i=0; params.buckets[i]!=0; i++){
-		snprintf(buf, sizeof(buf), "<%d\t", params.buckets[i]);
-		printcount(buf, total, counts.counters[i]);
+	if(params.bodyfile[0] != '\0'){
+		if((f = fopen(params.bodyfile, "r")) == nil)
+			panic("%s: can't open\n", params.bodyfile);
+		fseek(f, 0, SEEK_END);
+		npayload = ftell(f);
+		rewind(f);
+		payload = mal(npayload + 1);
+		if(fread(payload, 1, npayload, f) != npayload)
+			panic("%s: short read\n", params.bodyfile);
+		fclose(f);
+		params.bodylo = params.bodyhi = npayload;
+		return;
 	}
-	
-	snprintf(buf, sizeof(buf), ">=%d\t", params.buckets[i - 1]);
-	printcount(buf, total, counts.counters[i]);
-	
-	/* no total */
-	fprintf(stderr, "# hz\t\t%d\n", mkrate(&ratetv, counts.successes));
-}
 
-/*
-	Main, dispatch.
-*/
+	npayload = params.bodyhi;
+	for(i=0; i<params.nsizes; i++){
+		if(params.sizes[i] > npayload)
+			npayload = params.sizes[i];
+	}
+	payload = mal(npayload + 1);
+	for(i=0; i<npayload; i++){
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		payload[i] = 'a' + x % 26;
+	}
+}
 
 void
 usage(char *cmd)
@@ -432,8 +4187,14 @@ usage(char *cmd)
 	fprintf(
 		stderr,
 		"%s: [-c CONCURRENCY] [-b BUCKETS] "
-		"[-n COUNT] [-p NUMPROCS] [-r INTERVAL] [HOST] [PORT]\n",
-		cmd);
+		"[-n COUNT] [-p NUMPROCS] [-r RPC] [-i INTERVAL] "
+		"[-o SOCKOPTS] [-s SOURCES] [-t TARGETS] [-L POLICY] "
+		"[-T RESUME] [-H STREAMS] [-W WINDOW] [-K] [-J] [-P CPUS] "
+		"[-u PATH] [-f SCENARIO] [-m METHOD] [-d SIZE|LO-HI|@FILE] [-D SIZES] [-R RATE] [-I CONNS[,RATE]] [-S] [-X] [-E N] [-U PATH] [-M PID|CGROUP] [-B] [-w WARMUP] "
+		"[-C [HOST:]PORT -a AGENTS] "
+		"[HOST] [PORT]\n"
+		"%s: -A HOST:PORT [-s SOURCES]\n",
+		cmd, cmd);
 
 	exit(0);
 }
@@ -442,9 +4203,10 @@ int
 main(int argc, char **argv)
 {
 	int ch, i, nprocs = 1, is_parent = 1, port, *sockets, fds[2];
+	int nagents = 1, agentno = 0, cset = 0;
+	double d;
 	pid_t pid;
-	char *sp, *ap, *host, *cmd = argv[0];
-	struct hostent *he;
+	char *sp, *ap, *end, *host, *cmd = argv[0], *coord = nil, *agent = nil;
 
 	/* Defaults */
 	params.count = -1;
@@ -454,11 +4216,12 @@ main(int argc, char **argv)
 	params.buckets[0] = 1;
 	params.buckets[1] = 10;
 	params.buckets[2] = 100;
-	params.nbuckets = 4;
+	params.nbuckets = 3;
+	params.window = H2window;
 
 	memset(&counts, 0, sizeof(counts));
 
-	while((ch = getopt(argc, argv, "c:b:n:p:r:i:h")) != -1){
+	while((ch = getopt(argc, argv, "c:b:n:p:r:i:o:s:t:L:T:H:W:KJP:u:f:m:d:D:R:I:SXE:U:M:Bw:C:a:A:h")) != -1){
 		switch(ch){
 		case 'b':
 			sp = optarg;
@@ -481,6 +4244,7 @@ main(int argc, char **argv)
 
 		case 'c':
 			params.concurrency = atoi(optarg);
+			cset = 1;
 			break;
 
 		case 'n':
@@ -492,13 +4256,191 @@ main(int argc, char **argv)
 			break;
 
 		case 'i':
-			reporttv.tv_sec = atoi(optarg);
+			parseinterval(optarg, &reporttv);
 			break;
 
 		case 'r':
 			params.rpc = atoi(optarg);
 			break;
 
+		case 'o':
+			parseopts(optarg);
+			break;
+
+		case 's':
+			parsesrcs(optarg);
+			break;
+
+		case 't':
+			parsetargets(optarg);
+			break;
+
+		case 'L':
+			if(strcmp(optarg, "rr") == 0)
+				params.balance = Broundrobin;
+			else if(strcmp(optarg, "wrr") == 0)
+				params.balance = Bweighted;
+			else if(strcmp(optarg, "lo") == 0)
+				params.balance = Bleast;
+			else
+				panic("unknown balancing policy \"%s\"\n", optarg);
+			break;
+
+		case 'T':
+			/* else Nagle holds the request behind our Finished */
+			params.tls = 1;
+			params.nodelay = 1;
+			params.resume = atof(optarg);
+			if(params.resume < 0 || params.resume > 1)
+				panic("resumption ratio must be within [0, 1]\n");
+			break;
+
+		case 'H':
+			/* small control frames; don't let Nagle sit on them */
+			params.streams = atoi(optarg);
+			params.nodelay = 1;
+			if(params.streams < 1)
+				panic("need at least one stream per connection\n");
+			break;
+
+		case 'W':
+			params.window = atoi(optarg);
+			if(params.window < H2window || params.window > 0x7fffffff)
+				panic("window must be within [%d, 2^31)\n", H2window);
+			break;
+
+		case 'K':
+			params.tsc = 1;
+			break;
+
+		case 'B':
+			params.ab = 1;
+			break;
+
+		case 'w':
+			if(strcmp(optarg, "auto") == 0){
+				params.warmsteady = 1;
+				break;
+			}
+			d = strtod(optarg, &sp);
+			if(d <= 0)
+				panic("the warm-up must be positive\n");
+			if(strcmp(sp, "r") == 0)
+				params.warmreqs = d;
+			else if(*sp == '\0')
+				params.warmup = d * 1e9;
+			else
+				panic("warm-up: give SECONDS, REQUESTSr or auto\n");
+			break;
+
+		case 'R':
+			params.crate = atoi(optarg);
+			if(params.crate < 1)
+				panic("need a connect rate of at least 1/s\n");
+			break;
+
+		case 'S':
+			params.stream = 1;
+			break;
+
+		case 'X':
+			params.checksum = 1;
+			break;
+
+		case 'E':
+			params.slow = atoi(optarg);
+			if(params.slow < 1 || params.slow > MAX_SLOW)
+				panic("-E shows 1 to %d requests\n", MAX_SLOW);
+			break;
+
+		case 'I':
+			params.hold = strtol(optarg, &sp, 10);
+			if(params.hold < 1)
+				panic("need at least one connection to hold\n");
+			/* by default, each is used about once a minute */
+			params.holdrate = *sp == ',' ? atof(sp + 1) : params.hold / 60.0;
+			if(params.holdrate <= 0)
+				panic("need a request rate above 0\n");
+			break;
+
+		case 'u':
+			if(*optarg != '/')
+				panic("the path must begin with /\n");
+			Scp(params.path, optarg, sizeof(params.path));
+			break;
+
+		case 'f':
+			Scp(params.scenario, optarg, sizeof(params.scenario));
+			break;
+
+		case 'm':
+			if(strlen(optarg) >= sizeof(params.method) ||
+			    strspn(optarg, "ABCDEFGHIJKLMNOPQRSTUVWXYZ") != strlen(optarg))
+				panic("bad method \"%s\"\n", optarg);
+			Scp(params.method, optarg, sizeof(params.method));
+			break;
+
+		case 'd':
+			if(*optarg == '@'){
+				Scp(params.bodyfile, optarg + 1, sizeof(params.bodyfile));
+				break;
+			}
+			params.bodylo = params.bodyhi = parsebytes(optarg, &end);
+			if(*end == '-')
+				params.bodyhi = parsebytes(end + 1, &end);
+			if(*end != '\0' || params.bodylo < 0 || params.bodyhi < params.bodylo)
+				panic("-d takes SIZE, LO-HI or @FILE\n");
+			break;
+
+		case 'D':
+			for(sp = optarg; params.nsizes < MAX_SIZES; sp = end + 1){
+				params.sizes[params.nsizes++] = parsebytes(sp, &end);
+				if(*end != ',')
+					break;
+			}
+			if(*end != '\0' || params.sizes[0] <= 0)
+				panic("-D takes up to %d sizes, as 1k,64k,1m\n", MAX_SIZES);
+			break;
+
+		case 'J':
+#ifndef __linux__
+			panic("no kernel timestamps here\n");
+#endif
+			params.kts = 1;
+			break;
+
+		case 'P':
+#ifndef __linux__
+			panic("no pinning here\n");
+#endif
+			parsecpus(optarg);
+			break;
+
+		case 'U':
+			ctlpath = optarg;
+			break;
+
+		case 'M':
+#ifndef __linux__
+			panic("no /proc here\n");
+#endif
+			procspec = optarg;
+			break;
+
+		case 'C':
+			coord = optarg;
+			break;
+
+		case 'a':
+			nagents = atoi(optarg);
+			if(nagents < 1)
+				panic("need at least one agent\n");
+			break;
+
+		case 'A':
+			agent = optarg;
+			break;
+
 		case 'h':
 			usage(cmd);
 			break;
@@ -508,6 +4450,9 @@ main(int argc, char **argv)
 	argc -= optind;
 	argv += optind;
 
+	if(coord != nil && agent != nil)
+		panic("-C and -A don't mix\n");
+
 	host = "127.0.0.1";
 	port = 80;
 	switch(argc){
@@ -521,57 +4466,204 @@ main(int argc, char **argv)
 		panic("only 0 or 1(host port) pair are allowed\n");
 	}
 	
-	http_hostname = host;
-	http_port = port;
-	if(snprintf(http_hosthdr, sizeof(http_hosthdr), "%s:%d", host, port) > sizeof(http_hosthdr))
-		panic("snprintf");
+	/* an agent gets the rest from its coordinator */
+	if(agent != nil){
+		if(argc > 0 || nbackends > 0)
+			panic("an agent takes its targets from the coordinator\n");
+		nprocs = join(agent, &agentno, &nagents);
+	}else if(nbackends == 0)
+		addtarget(host, port, 1);
+	else if(argc > 0)
+		panic("give either -t or HOST PORT\n");
+
+	if(params.tls && params.streams > 0)
+		panic("h2 is cleartext only: -T and -H don't mix\n");
+	if(params.kts && (params.tls || params.streams > 0))
+		panic("kernel timestamps are for HTTP/1.1 in the clear\n");
+	if(params.crate > 0 && (params.tls || params.streams > 0))
+		panic("-R only connects: no -T or -H\n");
+	if(params.hold > 0 && (params.tls || params.streams > 0 ||
+	    params.crate > 0 || params.ab || params.kts))
+		panic("-I holds HTTP/1.1 in the clear: no -T, -H, -R, -B or -J\n");
+	if((params.method[0] != '\0' || params.bodyhi > 0 || params.bodyfile[0] != '\0' ||
+	    params.nsizes > 0) && (params.streams > 0 || params.crate > 0 ||
+	    params.hold > 0 || params.scenario[0] != '\0'))
+		panic("-m, -d and -D are for HTTP/1.1 requests: no -H, -R, -I or -f\n");
+	if(params.nsizes > 0 && (params.bodyhi > 0 || params.bodyfile[0] != '\0'))
+		panic("-D sweeps sizes itself: no -d\n");
+	if(params.slow > 0 && (params.crate > 0 || params.hold > 0))
+		panic("-E is for requests: no -R or -I\n");
+	if(ctlpath != nil && (params.crate > 0 || params.hold > 0 || agent != nil))
+		panic("-U changes requests, from the parent: no -R, -I or -A\n");
+	if(procspec != nil && agent != nil)
+		panic("-M watches a target on the parent's host: not with -A\n");
+	if(params.checksum && (params.streams > 0 || params.crate > 0 || params.hold > 0))
+		panic("-X checks HTTP/1.1 requests: no -H, -R or -I\n");
+	if(params.scenario[0] != '\0' && (params.streams > 0 || params.crate > 0 ||
+	    params.hold > 0 || params.path[0] != '\0'))
+		panic("-f runs HTTP/1.1 sessions: no -H, -R, -I or -u\n");
+	if(params.ab && nbackends != 2)
+		panic("-B compares two targets: give -t A,B\n");
+	if(params.ab && params.crate == 0 && params.concurrency % 2 != 0)
+		panic("-B splits -c between the targets; make it even\n");
+	if(params.ab)
+		params.balance = Broundrobin;
+
+	/* with -R, -c only bounds the connections in flight */
+	if(params.crate > 0 && !cset && agent == nil)
+		params.concurrency = 10000;
 
 	for(i = 0; params.buckets[i] != 0; i++)
 		request_timeout = params.buckets[i];
 
-	if(params.count > 0)
-		params.count /= nprocs;
+	if(params.count > 0 && agent == nil)
+		params.count /= nprocs * nagents;
+	if(params.hold > 0 && agent == nil){
+		params.hold /= nprocs * nagents;
+		if(params.hold < 1)
+			params.hold = 1;
+		params.holdrate /= nprocs * nagents;
+	}
+	if(params.crate > 0 && agent == nil){
+		params.crate /= nprocs * nagents;
+		if(params.crate < 1)
+			params.crate = 1;
+	}
 
 #if 0
 	event_init();
-	dispatch(mkhttp(), 1);
+	issue();
 	event_dispatch(); exit(0);
 #endif
 
-	fprintf(stderr, "# params: c=%d p=%d n=%d r=%d\n", 
-	    params.concurrency, nprocs, params.count, params.rpc);
+	/*
+		Before the header, which has columns for its bytes, and
+		the fork, so that the workers share its pages.
+	*/
+	if(params.bodyhi > 0 || params.bodyfile[0] != '\0' || params.nsizes > 0)
+		mkpayload();
+	if((sizes = calloc(params.nsizes + 1, sizeof(sizes[0]))) == nil)
+		panic("calloc");
+
+	if(agent != nil)
+		fprintf(stderr, "# agent %d: p=%d t=%d\n", agentno, nprocs,
+		    nbackends);
+	else{
+		fprintf(stderr, "# params: c=%d p=%d n=%d r=%d s=%d t=%d", 
+		    params.concurrency, nprocs, params.count, params.rpc, nsrcs,
+		    nbackends);
+		if(coord != nil)
+			fprintf(stderr, " a=%d", nagents);
+		if(params.tls)
+			fprintf(stderr, " T=%g", params.resume);
+		if(params.streams > 0)
+			fprintf(stderr, " H=%d W=%d", params.streams, params.window);
+		if(params.crate > 0)
+			fprintf(stderr, " R=%d", params.crate * nprocs * nagents);
+		if(params.hold > 0)
+			fprintf(stderr, " I=%d,%g", params.hold * nprocs * nagents,
+			    params.holdrate * nprocs * nagents);
+		if(params.warmsteady)
+			fprintf(stderr, " w=auto");
+		else if(params.warmreqs > 0)
+			fprintf(stderr, " w=%dr", params.warmreqs);
+		else if(params.warmup > 0)
+			fprintf(stderr, " w=%g", params.warmup / 1e9);
+		fprintf(stderr, "\n");
+
+		fprintf(stderr, "# ts\t\terrors\ttimeout\tcloses\t");
+		for(i=0; params.buckets[i]!=0; i++)
+			fprintf(stderr, "<%d\t", params.buckets[i]);
+
+		fprintf(stderr, ">=%d\thz\tlag\tcpu\tevs%s%s%s%s\n", params.buckets[i - 1],
+		    params.tls ? "\ths" : "", params.hold > 0 ? "\theld" : "",
+		    params.stream || payload != nil ? "\trx\ttx\tinMB/s\toutMB/s" : "",
+		    procspec != nil ? "\tt-usr\tt-sys\tt-rss\tt-vcs\tt-ivcs\tt-fds\tt-thr\tt-us/req" : "");
+		if(params.slow > 0)
+			fprintf(stderr, "# slow\tms\tend\tstatus\tconn\treqno\tbytes\t"
+			    "connect\ttls\tsend\twait\trecv\ttarget\n");
+	}
+
+	/* the coordinator sends no requests; its agents compile their own */
+	if(params.path[0] != '\0' && coord == nil){
+		reqpath = tmplparse(params.path);
+		if(reqpath->max + 300 > H2maxframe)
+			panic("the path can be too long\n");
+	}
+
+	/* everyone's: the parent reports by step */
+	if(params.scenario[0] != '\0'){
+		scen = scenload(params.scenario);
+		if((steps = calloc(scen->nsteps, sizeof(steps[0]))) == nil)
+			panic("calloc");
+	}
 
-	fprintf(stderr, "# ts\t\terrors\ttimeout\tcloses\t");
-	for(i=0; params.buckets[i]!=0; i++)
-		fprintf(stderr, "<%d\t", params.buckets[i]);
+	if(procspec != nil)
+		procopen(procspec);
 
-	fprintf(stderr, ">=%d\thz\n", params.buckets[i - 1]);
+	/* before the fork, so that the workers share a scale */
+	if(params.tsc && nsectsc() < 0)
+		fprintf(stderr, "# no invariant TSC; using the monotonic clock\n");
 
-	if((sockets = calloc(nprocs + 1, sizeof(int))) == nil)
+	/* a server that hangs up is an error, not a reason to die */
+	signal(SIGPIPE, SIG_IGN);
+
+	if((sockets = calloc(nagents*nprocs + 1, sizeof(int))) == nil)
 		panic("malloc\n");
 
 	sockets[nprocs] = -1;
 
+	if(coord != nil){
+		coordinate(coord, nagents, nprocs, sockets);
+		parentd(nagents*nprocs, sockets);
+		return(0);
+	}
+
 	for(i=0; i<nprocs; i++){
-		if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0){
-			perror("socketpair");
-			exit(1);
+		if(agent == nil){
+			if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0){
+				perror("socketpair");
+				exit(1);
+			}
+			sockets[i] = fds[0];
 		}
 
-		sockets[i] = fds[0];
-
 		if((pid = fork()) < 0){
 			kill(0, SIGINT);
 			perror("fork");
 			exit(1);
 		}else if(pid != 0){
-			close(fds[1]);
+			if(agent == nil)
+				close(fds[1]);
 			continue;
 		}
 
 		is_parent = 0;
 
+		/* report to the coordinator instead; this waits for the start */
+		if(agent != nil)
+			fds[1] = joinrun(agent);
+
+		if(params.ncpus > 0)
+			pin(i);
+		workerno = agentno*nprocs + i;
+		/* or every worker draws the same -d sizes and -I connections */
+		srandom(nsec() ^ getpid());
+		if(params.stream)
+			streambuf = mal(STREAM_BUF);
+		if(reqpath != nil)
+			tmplseed(reqpath, agentno*nprocs + i, nagents*nprocs);
+		if(scen != nil)
+			scenseed(scen, agentno*nprocs + i, nagents*nprocs);
+
+		/* spread the workers over the source addresses and targets */
+		if(nsrcs > 0)
+			nextsrc = i * (nsrcs / nprocs);
+		nextbackend = agentno*nprocs + i;
+
 		evbase = event_init();
+		if(params.tls)
+			tlsinit();
 
 		/* Set up output. */
 		if(dup2(fds[1], STDOUT_FILENO) < 0){
@@ -581,18 +4673,42 @@ main(int argc, char **argv)
 
 		close(fds[1]);
 
-		for(i=0; i<params.concurrency; i++)
-			dispatch(mkhttp(), 1);
+		if(params.crate > 0)
+			startpace();
+		else if(params.hold > 0)
+			starthold();
+		else{
+			startctl();
+			for(i=0; i<params.concurrency; i++){
+				if(params.ab){
+					backends[i % 2].loops++;
+					issueto(&backends[i % 2]);
+				}else
+					issue();
+			}
+		}
 
-		evtimer_set(&reportev, reportcb, nil);
+		/* persistent, so that intervals don't drift by the callback's latency */
+		lastreport = nsec();
+		event_set(&reportev, -1, EV_PERSIST, reportcb, nil);
 		evtimer_add(&reportev, &reporttv);
 
-		event_dispatch();
+		selfcpu();
+		startlag();
+
+		/* one iteration at a time, so that we can count them */
+		if(params.ncpus > 0)
+			spin();
+		else while(event_base_loop(evbase, EVLOOP_ONCE) == 0)
+			counts.loops++;
 
 		break;
 	}
 
-	if(is_parent)
+	if(is_parent && agent != nil){
+		while(wait(nil) > 0)
+			;
+	}else if(is_parent)
 		parentd(nprocs, sockets);
 
 	return(0);
@@ -0,0 +1,226 @@
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <event.h>
+
+#include "u.h"
+#include "http.h"
+
+enum{
+	Nvec = 16,	/* pieces of a buffer we sum or keep at once */
+};
+
+/*
+	The next line in b, not NUL terminated and valid until b is
+	drained; *n is its length and *eol that of its terminator.
+*/
+static char *
+peekln(struct evbuffer *b, size_t *n, size_t *eol)
+{
+	struct evbuffer_ptr p;
+
+	p = evbuffer_search_eol(b, nil, eol, EVBUFFER_EOL_CRLF);
+	if(p.pos < 0)
+		return nil;
+
+	*n = p.pos;
+	return (char *)evbuffer_pullup(b, p.pos + *eol);
+}
+
+/* is line (of length n) the header named hdr? then the value */
+static char *
+hdrval(char *line, size_t n, char *hdr)
+{
+	size_t len = strlen(hdr);
+
+	if(n <= len || strncasecmp(line, hdr, len) != 0 || line[len] != ':')
+		return nil;
+
+	for(line += len+1, n -= len+1; n > 0 && *line == ' '; line++, n--);
+	return line;
+}
+
+/* as much of p as r has room to keep */
+static void
+keep(struct resp *r, void *p, size_t n)
+{
+	if(r->keep == nil)
+		return;
+	if(n > r->akeep - r->nkeep)
+		n = r->akeep - r->nkeep;
+	memcpy(r->keep + r->nkeep, p, n);
+	r->nkeep += n;
+}
+
+/* n bytes of the body, or of the chunk and its CRLF, at p */
+static void
+consume(struct resp *r, uint8_t *p, size_t n)
+{
+	uint64_t a, b;
+	size_t i, data;
+
+	data = n;
+	if(r->state == Pchunk)
+		data = r->left <= 2 ? 0 : r->left - 2 < n ? r->left - 2 : n;
+	r->left -= n;
+	keep(r, p, data);
+	if(!r->sum)
+		return;
+
+	a = r->suma;
+	b = r->sumb;
+	for(i=0; i<data; i++){
+		a += p[i];
+		b += a;
+	}
+	r->suma = a;
+	r->sumb = b;
+}
+
+/*
+	Body bytes the caller read itself, no more than r->left of
+	them, while the parser is in a body or chunk.
+*/
+void
+respbody(struct resp *r, uint8_t *p, size_t n)
+{
+	consume(r, p, n);
+	if(r->left == 0)
+		r->state = r->state == Pbody ? Pdone : Pchunksize;
+}
+
+void
+respinit(struct resp *r)
+{
+	memset(r, 0, sizeof(*r));
+	r->state = Pstatus;
+}
+
+/*
+	Consume what we can of the response in in. Returns 1 when
+	the response is complete, 0 when more is needed, -1 on
+	a protocol error.
+*/
+int
+respparse(struct resp *r, struct evbuffer *in)
+{
+	char *line, *v;
+	size_t n, eol, len;
+	struct evbuffer_iovec iv[Nvec];
+	int i, nv;
+
+	for(;;) switch(r->state){
+	case Pstatus:
+	case Pheaders:
+	case Pchunksize:
+	case Ptrailers:
+		if((line = peekln(in, &n, &eol)) == nil){
+			if(evbuffer_get_length(in) > Maxline)
+				return -1;
+			return 0;
+		}
+
+		switch(r->state){
+		case Pstatus:
+			if(n < 12 || strncmp(line, "HTTP/1.", 7) != 0)
+				return -1;
+			r->code = atoi(line + 9);
+			r->keepalive = line[7] != '0';
+			r->chunked = 0;
+			r->left = -1;
+			r->state = Pheaders;
+			break;
+
+		case Pheaders:
+			if(n == 0){
+				if(r->code/100 == 1)
+					r->state = Pstatus;	/* 100 Continue */
+				else if(r->code == 204 || r->code == 304 || r->head)
+					r->state = Pdone;
+				else if(r->chunked)
+					r->state = Pchunksize;
+				else if(r->left >= 0)
+					r->state = Pbody;
+				else{
+					r->state = Peof;
+					r->keepalive = 0;
+				}
+				break;
+			}
+			if(r->keep != nil){
+				keep(r, line, n);
+				keep(r, "\n", 1);
+				r->nhead = r->nkeep;
+			}
+			if((v = hdrval(line, n, "Content-Length")) != nil)
+				r->left = strtoll(v, nil, 10);
+			else if((v = hdrval(line, n, "Transfer-Encoding")) != nil){
+				/* chunked is always the last coding */
+				len = n - (v - line);
+				r->chunked = len >= 7 &&
+				    strncasecmp(v + len - 7, "chunked", 7) == 0;
+			}
+			else if((v = hdrval(line, n, "Connection")) != nil){
+				len = n - (v - line);
+				if(len >= 5 && strncasecmp(v, "close", 5) == 0)
+					r->keepalive = 0;
+				else if(len >= 10 && strncasecmp(v, "keep-alive", 10) == 0)
+					r->keepalive = 1;
+			}
+			break;
+
+		case Pchunksize:
+			/* chunk data is followed by a CRLF; count it in */
+			r->left = strtoll(line, nil, 16);
+			r->state = r->left > 0 ? Pchunk : Ptrailers;
+			r->left += 2;
+			break;
+
+		case Ptrailers:
+			if(n == 0)
+				r->state = Pdone;
+			break;
+		}
+
+		evbuffer_drain(in, n + eol);
+		break;
+
+	case Pbody:
+	case Pchunk:
+		n = evbuffer_get_length(in);
+		if(n > r->left)
+			n = r->left;
+		if(r->sum || r->keep != nil){
+			nv = evbuffer_peek(in, n, nil, iv, Nvec);
+			for(len = n, i = 0; i < nv && i < Nvec; i++){
+				if(iv[i].iov_len > len)
+					iv[i].iov_len = len;
+				consume(r, iv[i].iov_base, iv[i].iov_len);
+				len -= iv[i].iov_len;
+			}
+			n -= len;	/* the rest, next time round */
+		}else
+			r->left -= n;
+		evbuffer_drain(in, n);
+		if(r->left > 0){
+			if(evbuffer_get_length(in) > 0)
+				break;
+			return 0;
+		}
+		r->state = r->state == Pbody ? Pdone : Pchunksize;
+		break;
+
+	case Peof:
+		/* the body runs until the server closes */
+		evbuffer_drain(in, evbuffer_get_length(in));
+		return 0;
+
+	case Pdone:
+		return 1;
+
+	default:
+		return -1;
+	}
+}
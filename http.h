@@ -0,0 +1,45 @@
+/*
+	HTTP/1.1 response parsing for the clients. The parser works
+	straight off an evbuffer and discards the body as it goes; it
+	keeps only what it needs to find the end of the response, and
+	a checksum of the body, or a copy of the headers and body, if
+	asked. A client may also read body bytes itself, around the
+	evbuffer, and hand them to respbody.
+*/
+
+enum{
+	Maxline = 65536,	/* longest status, header or chunk line */
+};
+
+enum{	/* parser states */
+	Pstatus,
+	Pheaders,
+	Pbody,
+	Pchunksize,
+	Pchunk,
+	Ptrailers,
+	Peof,		/* the body runs until close */
+	Pdone,
+};
+
+struct resp{
+	int state;
+	int code;
+	int keepalive;
+	int chunked;
+	int64_t left;		/* body or chunk bytes to go */
+	int head;		/* set after respinit: it answers a HEAD */
+
+	int sum;		/* set after respinit to sum the body */
+	uint64_t suma;		/* Fletcher's, over the bytes, mod 2^64 */
+	uint64_t sumb;
+
+	char *keep;		/* set after respinit to copy the response: */
+	size_t akeep;		/* the header lines, then the body, up to akeep */
+	size_t nkeep;
+	size_t nhead;		/* the header lines' part of it */
+};
+
+void	respinit(struct resp *r);
+int	respparse(struct resp *r, struct evbuffer *in);
+void	respbody(struct resp *r, uint8_t *p, size_t n);
@@ -0,0 +1,134 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include "u.h"
+#include "net.h"
+
+int
+isunix(char *host)
+{
+	return strncmp(host, "unix:", 5) == 0;
+}
+
+/* Resolve host and port into ss, once; we panic on failure. */
+void
+netaddr(char *host, int port, struct sockaddr_storage *ss)
+{
+	struct sockaddr_un *sun;
+	struct addrinfo hints, *ai;
+	char portstr[16];
+	int err;
+
+	memset(ss, 0, sizeof(*ss));
+
+	if(isunix(host)){
+		sun = (struct sockaddr_un *)ss;
+		if(strlen(host + 5) >= sizeof(sun->sun_path))
+			panic("%s: path too long", host);
+		sun->sun_family = AF_UNIX;
+		strcpy(sun->sun_path, host + 5);
+		return;
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	snprintf(portstr, sizeof(portstr), "%d", port);
+
+	if((err = getaddrinfo(host, portstr, &hints, &ai)) != 0)
+		panic("%s: %s", host, gai_strerror(err));
+
+	memcpy(ss, ai->ai_addr, ai->ai_addrlen);
+	freeaddrinfo(ai);
+}
+
+socklen_t
+sslen(struct sockaddr_storage *ss)
+{
+	switch(ss->ss_family){
+	case AF_INET6:
+		return sizeof(struct sockaddr_in6);
+	case AF_UNIX:
+		return sizeof(struct sockaddr_un);
+	default:
+		return sizeof(struct sockaddr_in);
+	}
+}
+
+/* Start a nonblocking connect to ss. Returns the socket, or -1. */
+int
+netdial(struct sockaddr_storage *ss)
+{
+	int fd;
+
+	fd = socket(ss->ss_family, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+	if(fd < 0)
+		return -1;
+
+	if(connect(fd, (struct sockaddr *)ss, sslen(ss)) < 0 &&
+	    errno != EINPROGRESS){
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*
+	Remove the Unix socket at ss if it is stale: one that nobody
+	listens on any more, left by an earlier run. Anything else at
+	the path is left alone, for bind to fail on.
+*/
+static void
+unstale(struct sockaddr_storage *ss)
+{
+	char *path = ((struct sockaddr_un *)ss)->sun_path;
+	struct stat st;
+	int fd;
+
+	if(lstat(path, &st) < 0 || !S_ISSOCK(st.st_mode))
+		return;
+	if((fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0)) < 0)
+		return;
+	if(connect(fd, (struct sockaddr *)ss, sslen(ss)) < 0 && errno == ECONNREFUSED)
+		unlink(path);
+	close(fd);
+}
+
+/*
+	A nonblocking listener on ss. A stale Unix socket left by an
+	earlier run is removed first; a live one is not.
+*/
+int
+netlisten(struct sockaddr_storage *ss)
+{
+	int fd, one = 1;
+
+	if(ss->ss_family == AF_UNIX)
+		unstale(ss);
+
+	fd = socket(ss->ss_family, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+	if(fd < 0)
+		return -1;
+
+	if(ss->ss_family != AF_UNIX)
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	if(bind(fd, (struct sockaddr *)ss, sslen(ss)) < 0 ||
+	    listen(fd, SOMAXCONN) < 0){
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
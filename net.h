@@ -0,0 +1,10 @@
+/*
+	Transport addresses. Wherever a host is given, unix:PATH
+	names a Unix domain socket instead; the port is then unused.
+*/
+
+int		isunix(char *host);
+void		netaddr(char *host, int port, struct sockaddr_storage *ss);
+socklen_t	sslen(struct sockaddr_storage *ss);
+int		netdial(struct sockaddr_storage *ss);
+int		netlisten(struct sockaddr_storage *ss);
@@ -0,0 +1,164 @@
+#include <sys/types.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "u.h"
+#include "proc.h"
+
+static int pid;			/* the process, or */
+static char cgroup[1024];	/* the cgroup's directory */
+static int64_t tick;		/* ns, of the CPU times in stat */
+static int64_t pagesize;
+
+/* the file at path into buf, with a NUL; its length, or -1 */
+static ssize_t
+readfile(char *path, char *buf, size_t n)
+{
+	ssize_t len;
+	int fd;
+
+	if((fd = open(path, O_RDONLY)) < 0)
+		return -1;
+	len = atomicio(read, fd, buf, n - 1);
+	close(fd);
+	if(len < 0)
+		return -1;
+	buf[len] = '\0';
+	return len;
+}
+
+/* the entries of dir, but . and .. */
+static int
+entries(char *dir)
+{
+	DIR *d;
+	struct dirent *e;
+	int n = 0;
+
+	if((d = opendir(dir)) == nil)
+		return 0;
+	while((e = readdir(d)) != nil){
+		if(e->d_name[0] != '.')
+			n++;
+	}
+	closedir(d);
+	return n;
+}
+
+/* A thread's context switches, from its status. */
+static void
+switches(char *path, struct usage *u)
+{
+	char buf[4096], *p;
+
+	if(readfile(path, buf, sizeof(buf)) < 0)
+		return;
+	if((p = strstr(buf, "\nvoluntary_ctxt_switches:")) != nil)
+		u->vcsw += strtoll(p + 25, nil, 10);
+	if((p = strstr(buf, "\nnonvoluntary_ctxt_switches:")) != nil)
+		u->ivcsw += strtoll(p + 28, nil, 10);
+}
+
+/*
+	Add process p's to u, and its CPU if cpu is set. Its status
+	has the switches of its first thread only; the rest are each
+	in their own.
+*/
+static void
+takepid(int p, struct usage *u, int cpu)
+{
+	char path[300], buf[1024], *s;
+	int64_t v[22];
+	DIR *d;
+	struct dirent *e;
+	int i;
+
+	/* the command may have spaces, or parentheses */
+	snprintf(path, sizeof(path), "/proc/%d/stat", p);
+	if(readfile(path, buf, sizeof(buf)) < 0 || (s = strrchr(buf, ')')) == nil)
+		return;
+
+	/* v[i] is field i+3, counting from 1; v[0], the state, isn't a number */
+	s += 3;
+	for(i=1; i<22; i++)
+		v[i] = strtoll(s, &s, 10);
+
+	u->nprocs++;
+	if(cpu){
+		u->user += v[11] * tick;
+		u->sys += v[12] * tick;
+	}
+	u->threads += v[17];
+	u->rss += v[21] * pagesize;
+
+	snprintf(path, sizeof(path), "/proc/%d/fd", p);
+	u->fds += entries(path);
+
+	snprintf(path, sizeof(path), "/proc/%d/task", p);
+	if((d = opendir(path)) == nil)
+		return;
+	while((e = readdir(d)) != nil){
+		if(e->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), "/proc/%d/task/%s/status", p, e->d_name);
+		switches(path, u);
+	}
+	closedir(d);
+}
+
+/* spec is a pid, or a cgroup's directory, under /sys/fs/cgroup if relative */
+void
+procopen(char *spec)
+{
+	char path[1100];
+
+	tick = 1000000000LL / sysconf(_SC_CLK_TCK);
+	pagesize = sysconf(_SC_PAGESIZE);
+
+	if(*spec != '\0' && strspn(spec, "0123456789") == strlen(spec)){
+		pid = atoi(spec);
+		snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	}else{
+		if(*spec == '/')
+			Scp(cgroup, spec, sizeof(cgroup));
+		else
+			snprintf(cgroup, sizeof(cgroup), "/sys/fs/cgroup/%s", spec);
+		snprintf(path, sizeof(path), "%s/cgroup.procs", cgroup);
+	}
+	if(access(path, R_OK) < 0)
+		panic("no process or cgroup \"%s\"", spec);
+}
+
+void
+proctake(struct usage *u)
+{
+	char path[1100], buf[512], *p;
+	FILE *f;
+	int n;
+
+	memset(u, 0, sizeof(*u));
+	if(pid > 0){
+		takepid(pid, u, 1);
+		return;
+	}
+
+	snprintf(path, sizeof(path), "%s/cpu.stat", cgroup);
+	if(readfile(path, buf, sizeof(buf)) >= 0){
+		if((p = strstr(buf, "user_usec ")) != nil)
+			u->user = strtoll(p + 10, nil, 10) * 1000;
+		if((p = strstr(buf, "system_usec ")) != nil)
+			u->sys = strtoll(p + 12, nil, 10) * 1000;
+	}
+
+	snprintf(path, sizeof(path), "%s/cgroup.procs", cgroup);
+	if((f = fopen(path, "r")) == nil)
+		return;
+	while(fscanf(f, "%d", &n) == 1)
+		takepid(n, u, 0);
+	fclose(f);
+}
@@ -0,0 +1,25 @@
+/*
+	What a target on this host uses, from /proc (Linux): a process,
+	by its pid, or the processes of a cgroup (v2), by its directory,
+	such as /sys/fs/cgroup/system.slice/nginx.service. The counters
+	are since the process began, so a report takes the difference
+	of two samples; rss, fds and threads are gauges.
+
+	A cgroup's CPU is its own account of it, which counts processes
+	that have come and gone; the rest are sums over the processes in
+	it at the time, so shared pages count once per process.
+*/
+
+struct usage{
+	int64_t user;		/* CPU, ns */
+	int64_t sys;
+	int64_t rss;		/* bytes */
+	int64_t vcsw;		/* context switches, voluntary */
+	int64_t ivcsw;		/* and not */
+	int fds;		/* open; those we may look at */
+	int threads;
+	int nprocs;		/* 0 once the process is gone */
+};
+
+void	procopen(char *spec);
+void	proctake(struct usage *u);
@@ -0,0 +1,244 @@
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <event.h>
+
+#include "u.h"
+#include "http.h"
+#include "tmpl.h"
+#include "scen.h"
+
+/* s (of length ns) in p (of length n), or nil */
+static char *
+find(char *p, size_t n, char *s, size_t ns)
+{
+	char *e;
+
+	if(ns == 0)
+		return p;
+	for(e = p + n; e - p >= ns; p++){
+		if(*p == *s && memcmp(p, s, ns) == 0)
+			return p;
+	}
+	return nil;
+}
+
+/* the value at p, up to e, into v's var */
+static void
+value(struct tmplvals *v, int var, char *p, char *e)
+{
+	size_t n;
+
+	for(n=0; p+n < e && n < Maxval && strchr("\"' ;&<>\r\n", p[n]) == nil; n++);
+	memcpy(v->v[var], p, n);
+	v->n[var] = n;
+}
+
+/* The header lines kept in r, for the value t takes. */
+static int
+takehdr(struct take *t, struct resp *r, struct tmplvals *v)
+{
+	char *p, *e, *eol, *q;
+	size_t len = strlen(t->hdr);
+
+	for(p = r->keep, e = r->keep + r->nhead; p < e; p = eol + 1){
+		if((eol = memchr(p, '\n', e - p)) == nil)
+			eol = e;
+		if(eol - p <= len || strncasecmp(p, t->hdr, len) != 0 || p[len] != ':')
+			continue;
+		for(q = p + len + 1; q < eol && *q == ' '; q++);
+		if((q = find(q, eol - q, t->prefix, t->nprefix)) == nil)
+			continue;
+		value(v, t->var, q + t->nprefix, eol);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+	Take st's values from r, kept whole; 0 if one of them isn't
+	there. Values are only looked for in what r kept.
+*/
+int
+scentake(struct step *st, struct resp *r, struct tmplvals *v)
+{
+	struct take *t;
+	char *p;
+	int i;
+
+	for(i=0; i<st->ntakes; i++){
+		t = &st->takes[i];
+		if(t->from == Xheader){
+			if(!takehdr(t, r, v))
+				return 0;
+			continue;
+		}
+		p = find(r->keep + r->nhead, r->nkeep - r->nhead, t->prefix, t->nprefix);
+		if(p == nil)
+			return 0;
+		value(v, t->var, p + t->nprefix, r->keep + r->nkeep);
+	}
+	return 1;
+}
+
+/* "NAME header HEADER [PREFIX]" or "NAME body PREFIX" */
+static void
+parsetake(struct step *st, char *s, int lineno)
+{
+	struct take *t;
+	char *name, *from;
+
+	name = strsep(&s, " \t");
+	from = strsep(&s, " \t");
+	if(name == nil || *name == '\0' || from == nil)
+		panic("scenario: line %d: > NAME header|body ...", lineno);
+
+	st->takes = remal(st->takes, (st->ntakes + 1) * sizeof(st->takes[0]));
+	t = &st->takes[st->ntakes++];
+	memset(t, 0, sizeof(*t));
+	t->var = tmplvar(name);
+
+	if(strcmp(from, "header") == 0){
+		t->from = Xheader;
+		if((t->hdr = strsep(&s, " \t")) == nil || *t->hdr == '\0')
+			panic("scenario: line %d: which header?", lineno);
+		t->hdr = strdup(t->hdr);
+		t->prefix = strdup(s != nil ? s : "");
+	}else if(strcmp(from, "body") == 0){
+		t->from = Xbody;
+		if(s == nil || *s == '\0')
+			panic("scenario: line %d: a body value needs a prefix", lineno);
+		t->prefix = strdup(s);
+	}else
+		panic("scenario: line %d: values come from a header or the body", lineno);
+	t->nprefix = strlen(t->prefix);
+}
+
+/* the values t uses that aren't in taken, as a mask */
+static uint32_t
+untaken(struct tmpl *t, uint32_t taken)
+{
+	uint32_t m = 0;
+	int i;
+
+	for(i=0; t != nil && i<t->nsegs; i++){
+		if(t->segs[i].kind == Gvar)
+			m |= 1<<t->segs[i].var;
+	}
+	return m & ~taken;
+}
+
+/* st is all read: compile it */
+static void
+endstep(struct scen *s, struct step *st, char *hdrs, char *body, uint32_t *taken)
+{
+	uint32_t m;
+	int i;
+
+	st->hdrs = tmplparse(hdrs);
+	if(body != nil)
+		st->body = tmplparse(body);
+
+	m = untaken(st->line, *taken) | untaken(st->hdrs, *taken) |
+	    untaken(st->body, *taken);
+	for(i=0; m != 0; i++, m >>= 1){
+		if(m & 1)
+			panic("scenario: step %d uses {$%s} before a step takes it",
+			    st - s->steps + 1, tmplvars[i]);
+	}
+	for(i=0; i<st->ntakes; i++)
+		*taken |= 1<<st->takes[i].var;
+	s->nsteps++;
+}
+
+/* Load the scenario at path, or panic. */
+struct scen *
+scenload(char *path)
+{
+	FILE *f;
+	struct scen *s;
+	struct step *st;
+	char *line, *hdrs, *body;
+	size_t n;
+	uint32_t taken;
+	int lineno;
+
+	if((f = fopen(path, "r")) == nil)
+		panic("scenario: can't open \"%s\"", path);
+
+	s = mal(sizeof(*s));
+	memset(s, 0, sizeof(*s));
+	st = nil;
+	hdrs = body = nil;
+	taken = 0;
+	lineno = 0;
+	while((line = xfgetln(f, &n)) != nil){
+		lineno++;
+		while(n > 0 && (line[n-1] == '\n' || line[n-1] == '\r'))
+			n--;
+		line[n] = '\0';
+		if(line[0] == '#')
+			continue;
+
+		if(n == 0){
+			if(st != nil)
+				endstep(s, st, hdrs, body, &taken);
+			st = nil;
+			continue;
+		}
+
+		if(st == nil){
+			if(s->nsteps == Maxsteps)
+				panic("scenario: more than %d steps", Maxsteps);
+			st = &s->steps[s->nsteps];
+			if(strchr(line, ' ') == nil)
+				panic("scenario: line %d: METHOD PATH, to begin a step", lineno);
+			st->name = strdup(line);
+			st->line = tmplparse(line);
+			st->head = strncmp(line, "HEAD ", 5) == 0;
+			hdrs = strdup("");
+			body = nil;
+		}else if(line[0] == '>')
+			parsetake(st, line + 1 + strspn(line + 1, " \t"), lineno);
+		else if(line[0] == '<'){
+			line += 1 + strspn(line + 1, " \t");
+			if(body == nil)
+				body = strdup(line);
+			else{
+				body = remal(body, strlen(body) + strlen(line) + 2);
+				strcat(strcat(body, "\n"), line);
+			}
+		}else{
+			if(strchr(line, ':') == nil)
+				panic("scenario: line %d: not a header", lineno);
+			hdrs = remal(hdrs, strlen(hdrs) + strlen(line) + 3);
+			strcat(strcat(hdrs, line), "\r\n");
+		}
+	}
+	if(st != nil)
+		endstep(s, st, hdrs, body, &taken);
+	fclose(f);
+
+	if(s->nsteps == 0)
+		panic("scenario: \"%s\" has no steps", path);
+	return s;
+}
+
+/* tmplseed, for every template of s */
+void
+scenseed(struct scen *s, int i, int n)
+{
+	struct step *st;
+	int k;
+
+	for(k=0; k<s->nsteps; k++){
+		st = &s->steps[k];
+		tmplseed(st->line, i, n);
+		tmplseed(st->hdrs, i, n);
+		if(st->body != nil)
+			tmplseed(st->body, i, n);
+	}
+}
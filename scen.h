@@ -0,0 +1,67 @@
+/*
+	Scenarios: sessions of requests, one step after another on a
+	connection, where a step may use values taken from the
+	responses to the steps before it. A scenario file has a step
+	per paragraph:
+
+		# log in, then fetch with the session cookie and token
+		POST /login
+		Content-Type: application/x-www-form-urlencoded
+		< user=u{seq}&password=secret
+		> sid header Set-Cookie sid=
+		> token body "token":"
+
+		GET /cart/{rand:1:100}
+		Cookie: sid={$sid}
+		Authorization: Bearer {$token}
+
+	The first line is the method and path; then come header lines,
+	a "<" line for a body (more than one are joined by newlines),
+	and ">" lines that take values:
+
+		> NAME header HEADER [PREFIX]	from the header's value
+		> NAME body PREFIX		from the body
+
+	A value is what follows PREFIX, up to a quote, space, ;, &, <,
+	> or the end of the line, and no longer than Maxval. All but
+	the ">" lines are templates (see tmpl.h); {$NAME} is a value,
+	which an earlier step must take. Lines beginning with # are
+	comments.
+*/
+
+enum{
+	Maxsteps = 32,
+	Maxkeep = 16384,	/* of a response, to take values from */
+};
+
+enum{	/* where values come from */
+	Xheader,
+	Xbody,
+};
+
+struct take{
+	int var;		/* its tmplvar number */
+	int from;
+	char *hdr;		/* Xheader */
+	char *prefix;
+	size_t nprefix;
+};
+
+struct step{
+	char *name;		/* its first line, for the report */
+	struct tmpl *line;	/* method and path */
+	struct tmpl *hdrs;	/* header lines, each with its CRLF */
+	struct tmpl *body;	/* nil for none */
+	struct take *takes;
+	int ntakes;
+	int head;		/* its method is HEAD: no body in the response */
+};
+
+struct scen{
+	struct step steps[Maxsteps];
+	int nsteps;
+};
+
+struct scen	*scenload(char *path);
+void		scenseed(struct scen *s, int i, int n);
+int		scentake(struct step *st, struct resp *r, struct tmplvals *v);
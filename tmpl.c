@@ -0,0 +1,348 @@
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "u.h"
+#include "tmpl.h"
+
+enum{
+	Maxdigits = 20,		/* of an int64 */
+};
+
+static uint64_t rng = 0x9e3779b97f4a7c15ULL;
+
+char	*tmplvars[Maxvars];
+int	ntmplvars;
+
+/* xorshift64*: plenty for spreading keys, and a few cycles */
+static uint64_t
+rand64(void)
+{
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return rng * 0x2545f4914f6cdd1dULL;
+}
+
+/* uniform over [0, 1) */
+static double
+rand01(void)
+{
+	return (rand64() >> 11) * (1.0 / (1ULL << 53));
+}
+
+/*
+	Zipf by rejection-inversion (Hörmann and Derflinger, 1996):
+	constant time and space whatever N, unlike a table of the CDF.
+	h is the density, H its integral, from which we invert.
+*/
+
+static double
+zhelper1(double x)
+{
+	if(fabs(x) > 1e-8)
+		return log1p(x) / x;
+	return 1 - x*(0.5 - x*(1.0/3 - 0.25*x));
+}
+
+static double
+zhelper2(double x)
+{
+	if(fabs(x) > 1e-8)
+		return expm1(x) / x;
+	return 1 + x*0.5*(1 + x*(1.0/3)*(1 + 0.25*x));
+}
+
+static double
+zh(double e, double x)
+{
+	return exp(-e * log(x));
+}
+
+static double
+zH(double e, double x)
+{
+	double lx = log(x);
+
+	return zhelper2((1 - e) * lx) * lx;
+}
+
+static double
+zHinv(double e, double x)
+{
+	double t = x * (1 - e);
+
+	if(t < -1)
+		t = -1;
+	return exp(zhelper1(t) * x);
+}
+
+static void
+zipfinit(struct seg *g)
+{
+	g->hx1 = zH(g->e, 1.5) - 1;
+	g->hn = zH(g->e, g->hi + 0.5);
+	g->sv = 2 - zHinv(g->e, zH(g->e, 2.5) - zh(g->e, 2));
+}
+
+static int64_t
+zipf(struct seg *g)
+{
+	double u, x;
+	int64_t k;
+
+	for(;;){
+		u = g->hn + rand01() * (g->hx1 - g->hn);
+		x = zHinv(g->e, u);
+		k = x + 0.5;
+		if(k < 1)
+			k = 1;
+		else if(k > g->hi)
+			k = g->hi;
+		if(k - x <= g->sv || u >= zH(g->e, k + 0.5) - zh(g->e, k))
+			return k;
+	}
+}
+
+/* The lines of path, for {file:PATH}. */
+static void
+loadfile(struct seg *g, char *path)
+{
+	FILE *f;
+	char *line;
+	size_t n, cap;
+
+	if((f = fopen(path, "r")) == nil)
+		panic("template: can't open \"%s\"", path);
+
+	cap = 1024;
+	g->lines = mal(cap * sizeof(g->lines[0]));
+	g->lens = mal(cap * sizeof(g->lens[0]));
+	g->nlines = 0;
+	while((line = xfgetln(f, &n)) != nil){
+		while(n > 0 && (line[n-1] == '\n' || line[n-1] == '\r'))
+			n--;
+		if(n == 0)
+			continue;
+		if(g->nlines == cap){
+			cap *= 2;
+			g->lines = remal(g->lines, cap * sizeof(g->lines[0]));
+			g->lens = remal(g->lens, cap * sizeof(g->lens[0]));
+		}
+		g->lines[g->nlines] = mal(n);
+		memcpy(g->lines[g->nlines], line, n);
+		g->lens[g->nlines++] = n;
+		if(n > g->n)
+			g->n = n;
+	}
+	fclose(f);
+
+	if(g->nlines == 0)
+		panic("template: \"%s\" is empty", path);
+}
+
+/* The number of the value called name, new or not. */
+int
+tmplvar(char *name)
+{
+	int i;
+
+	for(i=0; i<ntmplvars; i++){
+		if(strcmp(tmplvars[i], name) == 0)
+			return i;
+	}
+	if(ntmplvars == Maxvars)
+		panic("template: more than %d values", Maxvars);
+	tmplvars[ntmplvars] = strdup(name);
+	return ntmplvars++;
+}
+
+/* One placeholder, without its braces. */
+static void
+placeholder(struct seg *g, char *p)
+{
+	char *arg[3];
+	int n;
+
+	for(n=0; n<3 && (arg[n] = strsep(&p, ":")) != nil; n++);
+	if(p != nil)
+		panic("template: too many arguments in {%s}", arg[0]);
+
+	g->n = Maxdigits;
+	if(arg[0][0] == '$' && n == 1){
+		if(arg[0][1] == '\0')
+			panic("template: {$} has no name");
+		g->kind = Gvar;
+		g->var = tmplvar(arg[0] + 1);
+		g->n = Maxval;
+	}else if(strcmp(arg[0], "seq") == 0){
+		g->kind = Gseq;
+		g->lo = n > 1 ? strtoll(arg[1], nil, 10) : 0;
+		g->hi = n > 2 ? strtoll(arg[2], nil, 10) : INT64_MAX;
+		g->next = g->lo;
+		g->step = 1;
+	}else if(strcmp(arg[0], "rand") == 0 && n == 3){
+		g->kind = Grand;
+		g->lo = strtoll(arg[1], nil, 10);
+		g->hi = strtoll(arg[2], nil, 10);
+	}else if(strcmp(arg[0], "zipf") == 0 && n > 1){
+		g->kind = Gzipf;
+		g->lo = 1;
+		g->hi = strtoll(arg[1], nil, 10);
+		g->e = n > 2 ? atof(arg[2]) : 1;
+		if(g->e <= 0)
+			panic("template: zipf exponent must be >0");
+		zipfinit(g);
+	}else if(strcmp(arg[0], "file") == 0 && n == 2){
+		g->kind = Gfile;
+		g->n = 0;
+		loadfile(g, arg[1]);
+	}else
+		panic("template: bad placeholder {%s}", arg[0]);
+
+	if(g->kind != Gfile && g->hi < g->lo)
+		panic("template: empty range in {%s}", arg[0]);
+}
+
+/* Compile s, or panic. */
+struct tmpl *
+tmplparse(char *s)
+{
+	struct tmpl *t;
+	struct seg *g;
+	char *e;
+
+	t = mal(sizeof(*t));
+	memset(t, 0, sizeof(*t));
+	s = strdup(s);
+
+	while(*s != '\0'){
+		t->segs = remal(t->segs, (t->nsegs + 1) * sizeof(t->segs[0]));
+		g = &t->segs[t->nsegs++];
+		memset(g, 0, sizeof(*g));
+
+		if(*s != '{'){
+			g->kind = Gliteral;
+			g->s = s;
+			g->n = strcspn(s, "{");
+			s += g->n;
+		}else if(s[1] == '{'){
+			g->kind = Gliteral;
+			g->s = s;
+			g->n = 1;
+			s += 2;
+		}else{
+			if((e = strchr(s, '}')) == nil)
+				panic("template: unterminated {");
+			*e = '\0';
+			placeholder(g, s + 1);
+			s = e + 1;
+		}
+		t->max += g->n;
+	}
+
+	return t;
+}
+
+/*
+	Fill for the i-th of n processes: their sequences interleave
+	rather than repeat each other, and their random ones differ.
+*/
+void
+tmplseed(struct tmpl *t, int i, int n)
+{
+	struct seg *g;
+	int k;
+
+	rng ^= (uint64_t)nsec() * 0x9e3779b97f4a7c15ULL + i;
+	if(rng == 0)
+		rng = 1;
+
+	for(k=0; k<t->nsegs; k++){
+		g = &t->segs[k];
+		if(g->kind == Gseq){
+			g->next = g->lo + i % ((uint64_t)g->hi - g->lo + 1);
+			g->step = n;
+		}
+	}
+}
+
+/* v's digits at p; returns their number */
+static size_t
+putint(char *p, int64_t v)
+{
+	char d[Maxdigits + 1];
+	uint64_t u;
+	size_t n = 0, k;
+
+	u = v < 0 ? -(uint64_t)v : v;
+	do
+		d[n++] = '0' + u % 10;
+	while((u /= 10) > 0);
+	if(v < 0)
+		d[n++] = '-';
+
+	for(k=0; k<n; k++)
+		p[k] = d[n - 1 - k];
+	return n;
+}
+
+/* The next fill into buf, which holds t->max; returns its length. */
+size_t
+tmplfill(struct tmpl *t, char *buf)
+{
+	return tmplfillv(t, buf, nil);
+}
+
+/* The same, with vals for the {$NAME}s; they're empty without. */
+size_t
+tmplfillv(struct tmpl *t, char *buf, struct tmplvals *vals)
+{
+	struct seg *g;
+	char *p = buf;
+	uint64_t span;
+	int64_t v;
+	int k, l;
+
+	for(k=0; k<t->nsegs; k++){
+		g = &t->segs[k];
+		switch(g->kind){
+		case Gliteral:
+			memcpy(p, g->s, g->n);
+			p += g->n;
+			break;
+		case Gseq:
+			v = g->next;
+			if(g->hi - g->next < g->step)
+				g->next = g->lo + (g->next - g->lo + g->step) %
+				    ((uint64_t)g->hi - g->lo + 1);
+			else
+				g->next += g->step;
+			p += putint(p, v);
+			break;
+		case Grand:
+			span = (uint64_t)g->hi - g->lo + 1;
+			p += putint(p, g->lo + (span == 0 ? rand64() : rand64() % span));
+			break;
+		case Gzipf:
+			p += putint(p, zipf(g));
+			break;
+		case Gfile:
+			l = rand64() % g->nlines;
+			memcpy(p, g->lines[l], g->lens[l]);
+			p += g->lens[l];
+			break;
+		case Gvar:
+			if(vals != nil){
+				memcpy(p, vals->v[g->var], vals->n[g->var]);
+				p += vals->n[g->var];
+			}
+			break;
+		}
+	}
+
+	return p - buf;
+}
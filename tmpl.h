@@ -0,0 +1,66 @@
+/*
+	Request templates: text with placeholders in braces, each
+	filled in anew for every request.
+
+	{seq}, {seq:FROM}, {seq:FROM:TO}	counting up, wrapping after TO
+	{rand:LO:HI}			uniform over [LO, HI]
+	{zipf:N}, {zipf:N:S}		1..N, Zipf distributed with exponent
+					S (default 1), so 1 is the hottest
+	{file:PATH}			a line of PATH, uniformly at random
+	{$NAME}				the value NAME, of those given to
+					tmplfillv; see scen.h
+	{{				a {
+
+	A template is compiled once into a list of segments; filling
+	it is then a copy, or a number's digits, per segment, into a
+	buffer that holds the longest fill.
+*/
+
+enum{	/* segment kinds */
+	Gliteral,
+	Gseq,
+	Grand,
+	Gzipf,
+	Gfile,
+	Gvar,
+};
+
+enum{
+	Maxvars = 16,	/* names for {$NAME}, in all templates */
+	Maxval = 256,	/* the longest value */
+};
+
+/* values for the {$NAME}s, by tmplvar's number */
+struct tmplvals{
+	char v[Maxvars][Maxval];
+	size_t n[Maxvars];
+};
+
+struct seg{
+	int kind;
+	char *s;		/* literal */
+	size_t n;
+	int64_t lo;		/* seq, rand, zipf: the range */
+	int64_t hi;
+	int64_t next;		/* seq */
+	int64_t step;
+	double e, hx1, hn, sv;	/* zipf: exponent, precomputed */
+	char **lines;		/* file */
+	size_t *lens;
+	int nlines;
+	int var;		/* var */
+};
+
+struct tmpl{
+	struct seg *segs;
+	int nsegs;
+	size_t max;		/* the longest fill */
+};
+
+struct tmpl	*tmplparse(char *s);
+void		tmplseed(struct tmpl *t, int i, int n);
+size_t		tmplfill(struct tmpl *t, char *buf);
+size_t		tmplfillv(struct tmpl *t, char *buf, struct tmplvals *vals);
+int		tmplvar(char *name);
+extern char	*tmplvars[Maxvars];
+extern int	ntmplvars;
@@ -1,4 +1,5 @@
 #include <sys/types.h>
+#include <sys/time.h>
 #include <sys/uio.h>
 #include <unistd.h>
 #include <stdio.h>
@@ -6,6 +7,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
 
 #include "u.h"
 
@@ -77,7 +84,7 @@ remal(void *p, size_t siz)
 {
 	void *p1;
 	p1 = realloc(p, siz);
-	if(p==nil)
+	if(p1==nil)
 		panic("realloc");
 	return p1;
 }
@@ -102,7 +109,14 @@ xfgetln(FILE *fp, size_t *len)
 	*len = 0;
 	while ((ptr = strchr(&buf[*len], '\n')) == NULL) {
 		size_t nbufsiz = bufsiz + BUFSIZ;
-		char *nbuf = realloc(buf, nbufsiz);
+		char *nbuf;
+
+		/* a last line without its newline ends short of the buffer */
+		*len += strlen(&buf[*len]);
+		if (*len < bufsiz - 1)
+			return buf;
+
+		nbuf = realloc(buf, nbufsiz);
 
 		if (nbuf == NULL) {
 			int oerrno = errno;
@@ -113,13 +127,122 @@ xfgetln(FILE *fp, size_t *len)
 		} else
 			buf = nbuf;
 
-		*len = bufsiz;
-		if (fgets(&buf[bufsiz], BUFSIZ, fp) == NULL)
-			return buf;
-
 		bufsiz = nbufsiz;
+		if (fgets(&buf[*len], bufsiz - *len, fp) == NULL)
+			return buf;
 	}
 
 	*len = (ptr - buf) + 1;
 	return buf;
 }
+
+/*
+	Monotonic time in nanoseconds; only differences are meaningful.
+	After nsectsc, it is read from the CPU's time stamp counter
+	instead, scaled to the monotonic clock: a few cycles instead of
+	a trip through the vDSO. Forked children inherit the scale.
+*/
+
+static int64_t	tscns;		/* nsec() at tsc0 */
+static uint64_t	tsc0;
+static uint64_t	tscmult;	/* ns per tick, <<32; 0 when unused */
+
+static int64_t
+monons(void)
+{
+	struct timespec ts;
+
+	if(clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+		panic("clock_gettime");
+	return (int64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+int64_t
+nsec(void)
+{
+#if defined(__x86_64__)
+	if(tscmult != 0)
+		return tscns + (int64_t)(((unsigned __int128)(__rdtsc() - tsc0) * tscmult) >> 32);
+#endif
+	return monons();
+}
+
+/*
+	Calibrate the TSC against the monotonic clock, over 50ms.
+	Returns -1, and leaves nsec alone, if there is no TSC that
+	ticks at a constant rate, whatever the core's frequency and
+	C-state.
+*/
+int
+nsectsc(void)
+{
+#if defined(__x86_64__)
+	struct timespec pause = { 0, 50000000 };
+	unsigned a, b, c, d;
+	uint64_t t0, t1;
+	int64_t ns0, ns1;
+
+	if(!__get_cpuid(0x80000007, &a, &b, &c, &d) || !(d & (1<<8)))
+		return -1;
+
+	t0 = __rdtsc();
+	ns0 = monons();
+	nanosleep(&pause, nil);
+	t1 = __rdtsc();
+	ns1 = monons();
+
+	if(t1 <= t0 || ns1 <= ns0)
+		return -1;
+
+	tscmult = ((uint64_t)(ns1 - ns0) << 32) / (t1 - t0);
+	tsc0 = t1;
+	tscns = ns1;
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+/* Wall clock time in nanoseconds. */
+int64_t
+realnsec(void)
+{
+	struct timespec ts;
+
+	if(clock_gettime(CLOCK_REALTIME, &ts) < 0)
+		panic("clock_gettime");
+	return (int64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+/*
+	A reporting interval in seconds, possibly fractional, into tv;
+	it may not be shorter than 10ms.
+*/
+void
+parseinterval(char *s, struct timeval *tv)
+{
+	int64_t us;
+
+	us = (int64_t)(atof(s) * 1e6 + 0.5);
+	if(us < 10000)
+		panic("interval must be at least 0.01s");
+	tv->tv_sec = us / 1000000;
+	tv->tv_usec = us % 1000000;
+}
+
+/*
+	The timestamp column: whole seconds, as ever, unless the
+	interval is shorter than that; then milliseconds too.
+*/
+void
+printts(struct timeval *interval)
+{
+	int64_t ns;
+
+	ns = realnsec();
+	if(interval->tv_usec == 0)
+		printf("%lld\t", (long long)(ns / 1000000000));
+	else
+		printf("%lld.%03lld\t", (long long)(ns / 1000000000),
+		    (long long)(ns / 1000000 % 1000));
+}
@@ -8,3 +8,9 @@ ssize_t atomicio(ssize_t (f)(), int fd, void *_s, size_t n);
 void *mal(size_t siz);
 void *remal(void *p, size_t siz);
 char *xfgetln(FILE *fp, size_t *len);
+
+int64_t nsec(void);
+int nsectsc(void);
+int64_t realnsec(void);
+void parseinterval(char *s, struct timeval *tv);
+void printts(struct timeval *interval);